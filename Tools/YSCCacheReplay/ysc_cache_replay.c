@@ -0,0 +1,677 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ * Replays a cache access trace through the eviction policies of YSCImageCache and reports the hit rate, the byte
+ * hit rate and the bytes moved of each one, to pick a policy and a size limit from a real workload.
+ *
+ * Build:  cc -O2 -o ysc_cache_replay ysc_cache_replay.c
+ * Usage:  ysc_cache_replay -c <capacity in bytes> [-p lru|gdsf|size] <trace file>
+ *
+ * Two trace formats are read:
+ *   - the binary traces of `-[YSCImageCache startRecordingTraceAtPath:]`, see YSCImageCacheTraceRecorder.h. The
+ *     queries only read the simulated cache and the stores fill it, as recorded. The outcome of the cache that
+ *     recorded the trace is reported as the `recorded` row, followed by its latency percentiles. An image the
+ *     simulated cache evicts while the recorded one kept it is only stored again if the trace stores it again, so
+ *     the policies keeping less than the recorded cache are reported a bit pessimistically.
+ *   - text files with one query per line: `<timestamp in seconds> <key> <size in bytes>`. A query that misses
+ *     stores the image, like a download would. Lines starting with '#' are skipped.
+ *
+ * The policies:
+ *   lru   least recently used, the default of both cache layers
+ *   gdsf  Greedy Dual Size Frequency, the size aware policy of the memory cache. Images costing more than half of
+ *         the capacity are not admitted.
+ *   size  the size aware policy of the disk cache: when the cache goes over its capacity, the images are evicted by
+ *         size times time since the last read, down to 80% of the capacity
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+typedef enum {
+    PolicyLRU,
+    PolicyGDSF,
+    PolicySize,
+    PolicyCount
+} Policy;
+
+static const char *kPolicyNames[PolicyCount] = {"lru", "gdsf", "size"};
+
+// YSCImageCacheTraceRecorder
+static const uint32_t kTraceMagic = 0x31545359; // "YST1"
+enum {
+    OperationQuery = 1,
+    OperationStore = 2
+};
+enum {
+    TierNone = 0,
+    TierDisk = 1,
+    TierMemory = 2
+};
+
+// The disk cache trims down to its low watermark
+static const double kSizeLowWatermark = 0.8;
+// The disk index records the access times with this resolution
+static const double kSizeAccessTimeResolution = 60;
+
+typedef struct {
+    double timestamp;
+    uint64_t keyHash;
+    uint64_t size;
+    // the fields below are only read from the binary traces
+    uint32_t latency;
+    uint8_t operation;
+    uint8_t tier;
+} Query;
+
+typedef struct {
+    Query *queries;
+    size_t count;
+    // whether the trace records the stores, otherwise a miss stores the image
+    int recordsStores;
+} Trace;
+
+typedef struct {
+    uint64_t keyHash;
+    uint64_t size;
+    double accessTime;
+    uint64_t frequency;
+    double priority;
+    // LRU list, most recent at the head
+    int64_t prev;
+    int64_t next;
+    // hash chain
+    int64_t chain;
+    // GDSF heap position
+    int64_t heapIndex;
+    int live;
+} Entry;
+
+typedef struct {
+    Policy policy;
+    uint64_t capacity;
+    uint64_t totalSize;
+    Entry *entries;
+    int64_t entryCount;
+    int64_t entryCapacity;
+    int64_t freeList;
+    int64_t *buckets;
+    uint64_t bucketMask;
+    int64_t head;
+    int64_t tail;
+    int64_t *heap;
+    int64_t heapCount;
+    double inflation;
+    uint64_t evictionCount;
+} Cache;
+
+typedef struct {
+    uint64_t queries;
+    uint64_t hits;
+    uint64_t bytesRequested;
+    uint64_t bytesHit;
+    uint64_t bytesWritten;
+    uint64_t evictions;
+} Result;
+
+// MARK: - Trace
+
+// FNV-1a then a final mix, only used to tell the keys apart
+static uint64_t HashKey(const char *key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const unsigned char *c = (const unsigned char *)key; *c; c++) {
+        hash ^= *c;
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint64_t ReadLittleEndian(const unsigned char *bytes, int length) {
+    uint64_t value = 0;
+    for (int i = length - 1; i >= 0; i--) {
+        value = value << 8 | bytes[i];
+    }
+    return value;
+}
+
+static Query *ReadBinaryTrace(FILE *file, const char *path, size_t *count) {
+    unsigned char header[16];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)) {
+        fprintf(stderr, "%s: truncated header\n", path);
+        return NULL;
+    }
+    uint32_t recordSize = (uint32_t)ReadLittleEndian(header + 4, 4);
+    if (recordSize < 26 || recordSize > 4096) {
+        fprintf(stderr, "%s: unexpected record size %u\n", path, recordSize);
+        return NULL;
+    }
+    size_t capacity = 1024;
+    Query *queries = malloc(capacity * sizeof(Query));
+    *count = 0;
+    unsigned char record[4096];
+    // newer versions may append fields to the records, they're skipped
+    while (fread(record, 1, recordSize, file) == recordSize) {
+        uint8_t operation = record[24];
+        if (operation != OperationQuery && operation != OperationStore) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            queries = realloc(queries, capacity * sizeof(Query));
+        }
+        Query *query = &queries[(*count)++];
+        query->timestamp = ReadLittleEndian(record, 8) / 1e6;
+        query->keyHash = ReadLittleEndian(record + 8, 8);
+        query->size = ReadLittleEndian(record + 16, 4);
+        query->latency = (uint32_t)ReadLittleEndian(record + 20, 4);
+        query->operation = operation;
+        query->tier = record[25];
+    }
+    return queries;
+}
+
+// MARK: - Key sizes
+
+typedef struct {
+    uint64_t *keyHashes;
+    uint64_t *sizes;
+    uint64_t mask;
+} SizeTable;
+
+static uint64_t *SizeTableSlot(SizeTable *table, uint64_t keyHash) {
+    uint64_t i = keyHash & table->mask;
+    // 0 marks the empty slots, the callers skip the keys hashing to 0
+    while (table->keyHashes[i] != 0 && table->keyHashes[i] != keyHash) {
+        i = (i + 1) & table->mask;
+    }
+    table->keyHashes[i] = keyHash;
+    return &table->sizes[i];
+}
+
+// The misses don't know the size of what they asked for, it's taken from the other records of the key
+static void FillMissingSizes(Query *queries, size_t count) {
+    SizeTable table;
+    uint64_t slotCount = 1024;
+    while (slotCount < count * 2) {
+        slotCount <<= 1;
+    }
+    table.keyHashes = calloc(slotCount, sizeof(uint64_t));
+    table.sizes = calloc(slotCount, sizeof(uint64_t));
+    table.mask = slotCount - 1;
+    for (size_t q = 0; q < count; q++) {
+        if (queries[q].size > 0 && queries[q].keyHash != 0) {
+            *SizeTableSlot(&table, queries[q].keyHash) = queries[q].size;
+        }
+    }
+    for (size_t q = 0; q < count; q++) {
+        if (queries[q].size == 0 && queries[q].keyHash != 0) {
+            queries[q].size = *SizeTableSlot(&table, queries[q].keyHash);
+        }
+    }
+    free(table.keyHashes);
+    free(table.sizes);
+}
+
+static Query *ReadTextTrace(FILE *file, size_t *count) {
+    size_t capacity = 1024;
+    Query *queries = malloc(capacity * sizeof(Query));
+    *count = 0;
+    char line[4096];
+    char key[4096];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        double timestamp;
+        unsigned long long size;
+        if (sscanf(line, "%lf %4095s %llu", &timestamp, key, &size) != 3) {
+            fprintf(stderr, "skipping malformed line: %s", line);
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            queries = realloc(queries, capacity * sizeof(Query));
+        }
+        Query *query = &queries[(*count)++];
+        memset(query, 0, sizeof(*query));
+        query->timestamp = timestamp;
+        query->keyHash = HashKey(key);
+        query->size = size;
+        query->operation = OperationQuery;
+    }
+    return queries;
+}
+
+static int ReadTrace(const char *path, Trace *trace) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror(path);
+        return 0;
+    }
+    memset(trace, 0, sizeof(*trace));
+    unsigned char magic[4];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && ReadLittleEndian(magic, 4) == kTraceMagic) {
+        rewind(file);
+        trace->queries = ReadBinaryTrace(file, path, &trace->count);
+        trace->recordsStores = 1;
+        if (trace->queries) {
+            FillMissingSizes(trace->queries, trace->count);
+        }
+    } else {
+        rewind(file);
+        trace->queries = ReadTextTrace(file, &trace->count);
+    }
+    fclose(file);
+    return trace->queries != NULL;
+}
+
+// MARK: - Entries
+
+static void CacheInit(Cache *cache, Policy policy, uint64_t capacity, size_t queryCount) {
+    memset(cache, 0, sizeof(*cache));
+    cache->policy = policy;
+    cache->capacity = capacity;
+    cache->entryCapacity = 1024;
+    cache->entries = malloc(cache->entryCapacity * sizeof(Entry));
+    cache->freeList = -1;
+    uint64_t bucketCount = 1024;
+    while (bucketCount < queryCount) {
+        bucketCount <<= 1;
+    }
+    cache->buckets = malloc(bucketCount * sizeof(int64_t));
+    memset(cache->buckets, 0xff, bucketCount * sizeof(int64_t));
+    cache->bucketMask = bucketCount - 1;
+    cache->head = -1;
+    cache->tail = -1;
+    cache->heap = malloc(cache->entryCapacity * sizeof(int64_t));
+}
+
+static void CacheDestroy(Cache *cache) {
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache->heap);
+}
+
+static int64_t CacheFind(Cache *cache, uint64_t keyHash) {
+    for (int64_t i = cache->buckets[keyHash & cache->bucketMask]; i >= 0; i = cache->entries[i].chain) {
+        if (cache->entries[i].keyHash == keyHash) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void ListUnlink(Cache *cache, int64_t i) {
+    Entry *entry = &cache->entries[i];
+    if (entry->prev >= 0) {
+        cache->entries[entry->prev].next = entry->next;
+    } else {
+        cache->head = entry->next;
+    }
+    if (entry->next >= 0) {
+        cache->entries[entry->next].prev = entry->prev;
+    } else {
+        cache->tail = entry->prev;
+    }
+    entry->prev = -1;
+    entry->next = -1;
+}
+
+static void ListInsertAtHead(Cache *cache, int64_t i) {
+    Entry *entry = &cache->entries[i];
+    entry->prev = -1;
+    entry->next = cache->head;
+    if (cache->head >= 0) {
+        cache->entries[cache->head].prev = i;
+    }
+    cache->head = i;
+    if (cache->tail < 0) {
+        cache->tail = i;
+    }
+}
+
+// MARK: - GDSF heap
+
+static void HeapSwap(Cache *cache, int64_t a, int64_t b) {
+    int64_t entryA = cache->heap[a];
+    cache->heap[a] = cache->heap[b];
+    cache->heap[b] = entryA;
+    cache->entries[cache->heap[a]].heapIndex = a;
+    cache->entries[cache->heap[b]].heapIndex = b;
+}
+
+static double HeapPriority(Cache *cache, int64_t position) {
+    return cache->entries[cache->heap[position]].priority;
+}
+
+static void HeapSiftUp(Cache *cache, int64_t position) {
+    while (position > 0) {
+        int64_t parent = (position - 1) / 2;
+        if (HeapPriority(cache, parent) <= HeapPriority(cache, position)) {
+            break;
+        }
+        HeapSwap(cache, parent, position);
+        position = parent;
+    }
+}
+
+static void HeapSiftDown(Cache *cache, int64_t position) {
+    for (;;) {
+        int64_t smallest = position;
+        int64_t left = 2 * position + 1;
+        int64_t right = left + 1;
+        if (left < cache->heapCount && HeapPriority(cache, left) < HeapPriority(cache, smallest)) {
+            smallest = left;
+        }
+        if (right < cache->heapCount && HeapPriority(cache, right) < HeapPriority(cache, smallest)) {
+            smallest = right;
+        }
+        if (smallest == position) {
+            break;
+        }
+        HeapSwap(cache, smallest, position);
+        position = smallest;
+    }
+}
+
+static void HeapRemove(Cache *cache, int64_t i) {
+    int64_t position = cache->entries[i].heapIndex;
+    cache->heapCount--;
+    if (position != cache->heapCount) {
+        HeapSwap(cache, position, cache->heapCount);
+        HeapSiftUp(cache, position);
+        HeapSiftDown(cache, position);
+    }
+}
+
+static void UpdatePriority(Cache *cache, int64_t i) {
+    Entry *entry = &cache->entries[i];
+    // same as YSCMemoryCache, the cost of a miss is the same for every image
+    entry->priority = cache->inflation + (double)entry->frequency / (entry->size > 0 ? entry->size : 1);
+}
+
+// MARK: - Eviction
+
+static void CacheRemove(Cache *cache, int64_t i) {
+    Entry *entry = &cache->entries[i];
+    int64_t *link = &cache->buckets[entry->keyHash & cache->bucketMask];
+    while (*link != i) {
+        link = &cache->entries[*link].chain;
+    }
+    *link = entry->chain;
+    ListUnlink(cache, i);
+    if (cache->policy == PolicyGDSF) {
+        HeapRemove(cache, i);
+    }
+    cache->totalSize -= entry->size;
+    entry->live = 0;
+    entry->chain = cache->freeList;
+    cache->freeList = i;
+    cache->evictionCount++;
+}
+
+static double gSortTime;
+
+static int CompareSizeWeight(const void *a, const void *b) {
+    const Entry *entry1 = *(const Entry * const *)a;
+    const Entry *entry2 = *(const Entry * const *)b;
+    double weight1 = (gSortTime - entry1->accessTime + kSizeAccessTimeResolution) * (entry1->size > 0 ? entry1->size : 1);
+    double weight2 = (gSortTime - entry2->accessTime + kSizeAccessTimeResolution) * (entry2->size > 0 ? entry2->size : 1);
+    return weight1 < weight2 ? 1 : (weight1 > weight2 ? -1 : 0);
+}
+
+static void CacheTrim(Cache *cache, double now) {
+    if (cache->totalSize <= cache->capacity) {
+        return;
+    }
+    if (cache->policy == PolicyLRU) {
+        while (cache->totalSize > cache->capacity && cache->tail >= 0) {
+            CacheRemove(cache, cache->tail);
+        }
+    } else if (cache->policy == PolicyGDSF) {
+        while (cache->totalSize > cache->capacity && cache->heapCount > 0) {
+            int64_t i = cache->heap[0];
+            cache->inflation = cache->entries[i].priority;
+            CacheRemove(cache, i);
+        }
+    } else {
+        // a batch, sorted once like the disk index does for all the steps of a trim
+        Entry **live = malloc(cache->entryCount * sizeof(Entry *));
+        int64_t liveCount = 0;
+        for (int64_t i = 0; i < cache->entryCount; i++) {
+            if (cache->entries[i].live) {
+                live[liveCount++] = &cache->entries[i];
+            }
+        }
+        gSortTime = now;
+        qsort(live, liveCount, sizeof(Entry *), CompareSizeWeight);
+        uint64_t target = (uint64_t)(cache->capacity * kSizeLowWatermark);
+        for (int64_t i = 0; i < liveCount && cache->totalSize > target; i++) {
+            CacheRemove(cache, live[i] - cache->entries);
+        }
+        free(live);
+    }
+}
+
+// MARK: - Replay
+
+// Returns whether the image is admitted
+static int CacheInsert(Cache *cache, const Query *query) {
+    if (query->size > cache->capacity || (cache->policy == PolicyGDSF && query->size > cache->capacity / 2)) {
+        return 0;
+    }
+    int64_t i = cache->freeList;
+    if (i >= 0) {
+        cache->freeList = cache->entries[i].chain;
+    } else {
+        if (cache->entryCount == cache->entryCapacity) {
+            cache->entryCapacity *= 2;
+            cache->entries = realloc(cache->entries, cache->entryCapacity * sizeof(Entry));
+            cache->heap = realloc(cache->heap, cache->entryCapacity * sizeof(int64_t));
+        }
+        i = cache->entryCount++;
+    }
+    Entry *entry = &cache->entries[i];
+    memset(entry, 0, sizeof(*entry));
+    entry->keyHash = query->keyHash;
+    entry->size = query->size;
+    entry->accessTime = query->timestamp;
+    entry->frequency = 1;
+    entry->live = 1;
+    entry->prev = -1;
+    entry->next = -1;
+    uint64_t bucket = query->keyHash & cache->bucketMask;
+    entry->chain = cache->buckets[bucket];
+    cache->buckets[bucket] = i;
+    ListInsertAtHead(cache, i);
+    if (cache->policy == PolicyGDSF) {
+        UpdatePriority(cache, i);
+        entry->heapIndex = cache->heapCount;
+        cache->heap[cache->heapCount++] = i;
+        HeapSiftUp(cache, entry->heapIndex);
+    }
+    cache->totalSize += query->size;
+    CacheTrim(cache, query->timestamp);
+    return 1;
+}
+
+static Result Replay(const Trace *trace, Policy policy, uint64_t capacity) {
+    Cache cache;
+    CacheInit(&cache, policy, capacity, trace->count);
+    Result result;
+    memset(&result, 0, sizeof(result));
+    for (size_t q = 0; q < trace->count; q++) {
+        const Query *query = &trace->queries[q];
+        int64_t i = CacheFind(&cache, query->keyHash);
+        if (query->operation == OperationStore) {
+            // a store replaces the image, the way the cache does
+            if (i >= 0) {
+                CacheRemove(&cache, i);
+                // not an eviction
+                cache.evictionCount--;
+            }
+            if (CacheInsert(&cache, query)) {
+                result.bytesWritten += query->size;
+            }
+            continue;
+        }
+        result.queries++;
+        result.bytesRequested += query->size;
+        if (i < 0) {
+            if (!trace->recordsStores && CacheInsert(&cache, query)) {
+                result.bytesWritten += query->size;
+            }
+            continue;
+        }
+        Entry *entry = &cache.entries[i];
+        result.hits++;
+        result.bytesHit += entry->size;
+        entry->accessTime = query->timestamp;
+        entry->frequency++;
+        ListUnlink(&cache, i);
+        ListInsertAtHead(&cache, i);
+        if (policy == PolicyGDSF) {
+            UpdatePriority(&cache, i);
+            HeapSiftDown(&cache, entry->heapIndex);
+            HeapSiftUp(&cache, entry->heapIndex);
+        }
+    }
+    result.evictions = cache.evictionCount;
+    CacheDestroy(&cache);
+    return result;
+}
+
+// MARK: - Recorded
+
+static Result RecordedResult(const Trace *trace) {
+    Result result;
+    memset(&result, 0, sizeof(result));
+    for (size_t q = 0; q < trace->count; q++) {
+        const Query *query = &trace->queries[q];
+        if (query->operation == OperationStore) {
+            result.bytesWritten += query->size;
+            continue;
+        }
+        result.queries++;
+        result.bytesRequested += query->size;
+        if (query->tier != TierNone) {
+            result.hits++;
+            result.bytesHit += query->size;
+        }
+    }
+    return result;
+}
+
+static int CompareLatency(const void *a, const void *b) {
+    uint32_t latency1 = *(const uint32_t *)a;
+    uint32_t latency2 = *(const uint32_t *)b;
+    return latency1 < latency2 ? -1 : (latency1 > latency2 ? 1 : 0);
+}
+
+// tier < 0 matches all the tiers
+static void PrintLatencies(const Trace *trace, const char *name, uint8_t operation, int tier) {
+    uint32_t *latencies = malloc((trace->count > 0 ? trace->count : 1) * sizeof(uint32_t));
+    size_t count = 0;
+    for (size_t q = 0; q < trace->count; q++) {
+        const Query *query = &trace->queries[q];
+        if (query->operation == operation && (tier < 0 || query->tier == tier)) {
+            latencies[count++] = query->latency;
+        }
+    }
+    if (count > 0) {
+        qsort(latencies, count, sizeof(uint32_t), CompareLatency);
+        printf("%-13s %12zu %10u %10u %10u %10u\n", name, count, latencies[(count - 1) * 50 / 100],
+               latencies[(count - 1) * 90 / 100], latencies[(count - 1) * 99 / 100], latencies[count - 1]);
+    }
+    free(latencies);
+}
+
+static void PrintResult(const char *name, const Result *result, int printsEvictions) {
+    double hitRate = result->queries > 0 ? (double)result->hits / result->queries : 0;
+    double byteHitRate = result->bytesRequested > 0 ? (double)result->bytesHit / result->bytesRequested : 0;
+    printf("%-8s %12llu %9.2f%% %14.2f%% %12.2f %12.2f ", name, (unsigned long long)result->queries,
+           hitRate * 100, byteHitRate * 100, result->bytesHit / 1e6, result->bytesWritten / 1e6);
+    if (printsEvictions) {
+        printf("%12llu\n", (unsigned long long)result->evictions);
+    } else {
+        printf("%12s\n", "-");
+    }
+}
+
+static void Usage(const char *name) {
+    fprintf(stderr, "usage: %s -c <capacity in bytes> [-p lru|gdsf|size] <trace file>\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t capacity = 0;
+    int policies[PolicyCount] = {1, 1, 1};
+    int option;
+    while ((option = getopt(argc, argv, "c:p:h")) != -1) {
+        switch (option) {
+            case 'c':
+                capacity = strtoull(optarg, NULL, 10);
+                break;
+            case 'p': {
+                int found = 0;
+                for (int p = 0; p < PolicyCount; p++) {
+                    policies[p] = strcmp(optarg, kPolicyNames[p]) == 0;
+                    found |= policies[p];
+                }
+                if (!found) {
+                    fprintf(stderr, "unknown policy: %s\n", optarg);
+                    return 1;
+                }
+                break;
+            }
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (capacity == 0 || optind != argc - 1) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    Trace trace;
+    if (!ReadTrace(argv[optind], &trace)) {
+        return 1;
+    }
+
+    // the bytes moved: read from the cache by the hits, written to it by the stores
+    printf("%-8s %12s %10s %15s %12s %12s %12s\n", "policy", "queries", "hit rate", "byte hit rate", "MB read",
+           "MB written", "evictions");
+    if (trace.recordsStores) {
+        Result result = RecordedResult(&trace);
+        PrintResult("recorded", &result, 0);
+    }
+    for (int p = 0; p < PolicyCount; p++) {
+        if (!policies[p]) {
+            continue;
+        }
+        Result result = Replay(&trace, (Policy)p, capacity);
+        PrintResult(kPolicyNames[p], &result, 1);
+    }
+
+    if (trace.recordsStores) {
+        printf("\n%-13s %12s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p90", "p99", "max");
+        PrintLatencies(&trace, "query", OperationQuery, -1);
+        PrintLatencies(&trace, "query memory", OperationQuery, TierMemory);
+        PrintLatencies(&trace, "query disk", OperationQuery, TierDisk);
+        PrintLatencies(&trace, "query miss", OperationQuery, TierNone);
+        PrintLatencies(&trace, "store", OperationStore, -1);
+    }
+    free(trace.queries);
+    return 0;
+}
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import "YSCWebImageCompat.h"
 #import "YSCImageCacheConfig.h"
+#import "YSCImageCacheMetrics.h"
 
 typedef NS_ENUM(NSInteger, YSCImageCacheType) {
     /**
@@ -31,6 +32,89 @@ typedef void(^YSCWebImageCheckCacheCompletionBlock)(BOOL isInCache);
 
 typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger totalSize);
 
+/**
+ * The result of a key of a batched cache query
+ */
+@interface YSCImageCacheQueryResult : NSObject
+
+@property (nonatomic, copy, readonly, nonnull) NSString *key;
+@property (nonatomic, strong, readonly, nullable) UIImage *image;
+@property (nonatomic, strong, readonly, nullable) NSData *data;
+/**
+ * YSCImageCacheTypeNone when the key is in none of the caches
+ */
+@property (nonatomic, assign, readonly) YSCImageCacheType cacheType;
+
+@end
+
+/**
+ * @param results  The results delivered by this call, each key is delivered once
+ * @param finished YES for the last call, once all the keys have been delivered
+ */
+typedef void(^YSCCacheBatchQueryCompletedBlock)(NSArray<YSCImageCacheQueryResult *> * _Nonnull results, BOOL finished);
+
+/**
+ * Memory cache counters. Hits, misses and evictions are accumulated since the cache was created or the counters
+ * were last reset, the resident values describe the memory cache right now.
+ */
+typedef struct YSCImageCacheMemoryCounters {
+    /**
+     * The number of memory cache lookups that found an image
+     */
+    uint64_t hitCount;
+    /**
+     * The number of memory cache lookups that found nothing
+     */
+    uint64_t missCount;
+    /**
+     * The number of images the memory cache evicted on its own to stay under its limits
+     */
+    uint64_t evictionCount;
+    /**
+     * The decoded size of the images held in memory, in bytes
+     */
+    uint64_t residentBytes;
+    /**
+     * The number of images held in memory
+     */
+    uint64_t residentCount;
+    /**
+     * The number of decoded tier misses that found the encoded data in memory, saving a disk read
+     */
+    uint64_t dataHitCount;
+    /**
+     * The size of the encoded data held in memory, in bytes
+     */
+    uint64_t dataResidentBytes;
+} YSCImageCacheMemoryCounters;
+
+/**
+ * Disk read counters, accumulated since the cache was created or the counters were last reset.
+ * Divide `fileReadAttempts` and `bytesRead` by `diskQueryCount` to get the per query cost.
+ */
+typedef struct YSCImageCacheDiskReadCounters {
+    /**
+     * The number of disk lookups (a key searched across all the cache paths)
+     */
+    uint64_t diskQueryCount;
+    /**
+     * The number of files we tried to read, each one costs at least an open() syscall
+     */
+    uint64_t fileReadAttempts;
+    /**
+     * The total number of bytes read from disk
+     */
+    uint64_t bytesRead;
+    /**
+     * The part of `bytesRead` that was memory mapped instead of copied
+     */
+    uint64_t bytesMapped;
+    /**
+     * The number of files moved out of the cache because their size or checksum didn't match
+     */
+    uint64_t quarantinedFileCount;
+} YSCImageCacheDiskReadCounters;
+
 
 /**
  * YSCImageCache maintains a memory cache and an optional disk cache. Disk cache write operations are performed
@@ -46,7 +130,8 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
 @property (nonatomic, nonnull, readonly) YSCImageCacheConfig *config;
 
 /**
- * The maximum "total cost" of the in-memory image cache. The cost function is the number of pixels held in memory.
+ * The maximum "total cost" of the in-memory image cache. The cost function is the decoded size of the images in bytes,
+ * including the row padding and every frame of animated images.
  */
 @property (assign, nonatomic) NSUInteger maxMemoryCost;
 
@@ -55,6 +140,18 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
  */
 @property (assign, nonatomic) NSUInteger maxMemoryCountLimit;
 
+/**
+ * The maximum size of the in-memory encoded data tier, in bytes. This tier keeps the compressed data of recently used
+ * images, so an image evicted from the decoded tier is decoded again from memory instead of being read from disk.
+ * Defaults to 16 MB, 0 means no limit.
+ */
+@property (assign, nonatomic) NSUInteger maxMemoryDataCost;
+
+/**
+ * The maximum number of entries of the in-memory encoded data tier. Defaults to 0, which means no limit.
+ */
+@property (assign, nonatomic) NSUInteger maxMemoryDataCountLimit;
+
 #pragma mark - Singleton and initialization
 
 /**
@@ -135,6 +232,25 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
             toDisk:(BOOL)toDisk
         completion:(nullable YSCWebImageNoParamsBlock)completionBlock;
 
+/**
+ * Asynchronously store an image into memory and disk cache at the given key, expiring after its own max age instead
+ * of the `maxCacheAge` of the config. An expired image is not returned anymore, from memory or disk, and its file is
+ * removed. The pack file layout ignores the max age.
+ *
+ * @param image           The image to store
+ * @param imageData       The image data as returned by the server, or nil to encode the image
+ * @param key             The unique image cache key, usually it's image absolute URL
+ * @param toDisk          Store the image to disk cache if YES
+ * @param maxAge          How long the image stays in the cache, in seconds. 0 follows the `maxCacheAge` of the config.
+ * @param completionBlock A block executed after the operation is finished
+ */
+- (void)storeImage:(nullable UIImage *)image
+         imageData:(nullable NSData *)imageData
+            forKey:(nullable NSString *)key
+            toDisk:(BOOL)toDisk
+            maxAge:(NSTimeInterval)maxAge
+        completion:(nullable YSCWebImageNoParamsBlock)completionBlock;
+
 /**
  * Synchronously store image NSData into disk cache at the given key.
  *
@@ -145,6 +261,11 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
  */
 - (void)storeImageDataToDisk:(nullable NSData *)imageData forKey:(nullable NSString *)key;
 
+/**
+ * Write the stores waiting in the write buffer now, instead of after `diskCacheWriteDelay`.
+ */
+- (void)flushPendingWrites;
+
 #pragma mark - Query and Retrieve Ops
 
 /**
@@ -166,6 +287,20 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
  */
 - (nullable NSOperation *)queryCacheOperationForKey:(nullable NSString *)key done:(nullable YSCCacheQueryCompletedBlock)doneBlock;
 
+/**
+ * Operation that queries the cache for many keys at once, cheaper than one query per key.
+ *
+ * The memory hits are looked up in a single pass and delivered synchronously in a first call. The other keys are read
+ * on their IO queue in one block per queue, sorted by location on disk, and delivered on the main queue a few at a
+ * time. The last call has `finished` set.
+ *
+ * @param keys      The unique keys used to store the wanted images
+ * @param doneBlock The completion block. Will not get called anymore once the operation is cancelled
+ *
+ * @return a NSOperation instance containing the cache op, nil if all the keys were found in memory
+ */
+- (nullable NSOperation *)queryCacheOperationsForKeys:(nonnull NSArray<NSString *> *)keys done:(nullable YSCCacheBatchQueryCompletedBlock)doneBlock;
+
 /**
  * Query the memory cache synchronously.
  *
@@ -187,6 +322,56 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
  */
 - (nullable UIImage *)imageFromCacheForKey:(nullable NSString *)key;
 
+#pragma mark - Memory counters
+
+/**
+ * Returns a snapshot of the memory cache counters.
+ */
+- (YSCImageCacheMemoryCounters)memoryCounters;
+
+/**
+ * Reset the hit, miss and eviction counters to zero.
+ */
+- (void)resetMemoryCounters;
+
+#pragma mark - Disk read counters
+
+/**
+ * Returns a snapshot of the disk read counters.
+ */
+- (YSCImageCacheDiskReadCounters)diskReadCounters;
+
+/**
+ * Reset all the disk read counters to zero.
+ */
+- (void)resetDiskReadCounters;
+
+#pragma mark - Metrics
+
+/**
+ * Returns a snapshot of the metrics recorded while `config.shouldCollectMetrics` is YES.
+ *
+ * @param reset Whether to reset the metrics, so consecutive snapshots cover consecutive intervals without losing
+ *              the samples recorded in between
+ */
+- (YSCImageCacheMetrics)metricsByResetting:(BOOL)reset;
+
+#pragma mark - Trace
+
+/**
+ * Start recording the queries and the stores to a binary trace, for `Tools/YSCCacheReplay`.
+ * See `YSCImageCacheTraceRecorder` for the format. A trace already recorded is stopped.
+ *
+ * @param path The path of the trace file, replaced if it exists
+ * @return NO if the file can't be created
+ */
+- (BOOL)startRecordingTraceAtPath:(nonnull NSString *)path;
+
+/**
+ * Stop recording the trace and write it to its file, in the background.
+ */
+- (void)stopRecordingTrace;
+
 #pragma mark - Remove Ops
 
 /**
@@ -213,6 +398,22 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
  */
 - (void)clearMemory;
 
+/**
+ * Evict the least recently used images from memory until the memory cache holds at most `ratio` of its current
+ * cost and count. A ratio of 0 clears the memory cache.
+ *
+ * @param ratio The fraction of the memory cache to keep, between 0 and 1
+ */
+- (void)trimMemoryToRatio:(double)ratio;
+
+/**
+ * Async read and decode into memory the most recently used images recorded when the app last went to the background,
+ * up to the `memoryCacheHotSetCost` of the config when this is called, so call it once the config is set.
+ * The images stored or queried meanwhile are kept. Non-blocking method - returns immediately.
+ * @param completionBlock A block that should be executed on the main queue after the preload completes (optional)
+ */
+- (void)preloadHotSetWithCompletionBlock:(nullable YSCWebImageNoParamsBlock)completionBlock;
+
 /**
  * Async clear all disk cached images. Non-blocking method - returns immediately.
  * @param completion    A block that should be executed after cache expiration completes (optional)
@@ -220,7 +421,8 @@ typedef void(^YSCWebImageCalculateSizeBlock)(NSUInteger fileCount, NSUInteger to
 - (void)clearDiskOnCompletion:(nullable YSCWebImageNoParamsBlock)completion;
 
 /**
- * Async remove all expired cached image from disk. Non-blocking method - returns immediately.
+ * Async remove all expired cached image from disk, then evict the least recently used images down to the
+ * `diskCacheLowWatermark` of the config. Non-blocking method - returns immediately.
  * @param completionBlock A block that should be executed after cache expiration completes (optional)
  */
 - (void)deleteOldFilesWithCompletionBlock:(nullable YSCWebImageNoParamsBlock)completionBlock;
@@ -7,56 +7,199 @@
  */
 
 #import "YSCImageCache.h"
-#import <CommonCrypto/CommonDigest.h>
+#import <stdatomic.h>
+#import <objc/runtime.h>
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
 #import "NSImage+YSCWebCache.h"
 #import "YSCWebImageCodersManager.h"
+#import "YSCImageCachePackStorage.h"
+#import "YSCImageCacheIndex.h"
+#import "YSCMemoryCache.h"
+#import "YSCImageCacheKey.h"
+#import "YSCImageCacheFilter.h"
+#import "YSCImageCacheTraceRecorder.h"
+#import <mach/mach_time.h>
+
+FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForCGImage(CGImageRef _Nullable imageRef) {
+    if (!imageRef) {
+        return 0;
+    }
+    // bytes per row includes the row padding the decoded bitmap really uses
+    return CGImageGetBytesPerRow(imageRef) * CGImageGetHeight(imageRef);
+}
 
-// See https://github.com/rs/YSCWebImage/pull/1141 for discussion
-@interface YSCAutoPurgeCache : NSCache
-@end
-
-@implementation YSCAutoPurgeCache
+// Animated images keep their encoded data, so a memory hit can return it without reading the disk.
+// The data is only attached before the image is put in the memory cache, so its cost counts it. Once the image is in the
+// cache, the data found later goes to the data tier instead, which counts it there.
+static void *kYSCAnimatedImageDataKey = &kYSCAnimatedImageDataKey;
 
-- (nonnull instancetype)init {
-    self = [super init];
-    if (self) {
-#if YSC_UIKIT
-        [[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(removeAllObjects) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
-#endif
+static void YSCSetImageDataForAnimatedImage(UIImage * _Nullable image, NSData * _Nullable data) {
+    if (image.images && data) {
+        objc_setAssociatedObject(image, kYSCAnimatedImageDataKey, data, OBJC_ASSOCIATION_RETAIN);
     }
-    return self;
 }
 
-- (void)dealloc {
-#if YSC_UIKIT
-    [[NSNotificationCenter defaultCenter] removeObserver:self name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+static NSData * _Nullable YSCImageDataForAnimatedImage(UIImage * _Nullable image) {
+    return image.images ? objc_getAssociatedObject(image, kYSCAnimatedImageDataKey) : nil;
+}
+
+// The decoded size of the image in bytes, counting every distinct frame of an animated image
+static NSUInteger YSCCacheCostForImageBitmap(UIImage *image) {
+#if YSC_MAC
+    NSUInteger frameCount = 1;
+    for (NSImageRep *rep in image.representations) {
+        if ([rep isKindOfClass:[NSBitmapImageRep class]]) {
+            frameCount = MAX([[(NSBitmapImageRep *)rep valueForProperty:NSImageFrameCount] unsignedIntegerValue], 1);
+            break;
+        }
+    }
+    return YSCCacheCostForCGImage(image.CGImage) * frameCount;
+#elif YSC_UIKIT || YSC_WATCH
+    NSArray<UIImage *> *frames = image.images.count > 0 ? image.images : @[image];
+    // Animated images repeat the same frame to match the frame durations, only count it once
+    NSMutableSet<NSValue *> *countedImageRefs = [NSMutableSet setWithCapacity:frames.count];
+    NSUInteger cost = 0;
+    for (UIImage *frame in frames) {
+        CGImageRef imageRef = frame.CGImage;
+        if (!imageRef) {
+            // not bitmap backed, assume 4 bytes per pixel
+            cost += frame.size.height * frame.size.width * frame.scale * frame.scale * 4;
+            continue;
+        }
+        NSValue *imageRefValue = [NSValue valueWithPointer:imageRef];
+        if (![countedImageRefs containsObject:imageRefValue]) {
+            [countedImageRefs addObject:imageRefValue];
+            cost += YSCCacheCostForCGImage(imageRef);
+        }
+    }
+    return cost;
 #endif
 }
 
+// The memory cost of the image, its bitmap plus the encoded data kept by animated images
+static NSUInteger YSCCacheCostForImage(UIImage *image) {
+    return YSCCacheCostForImageBitmap(image) + YSCImageDataForAnimatedImage(image).length;
+}
+
+// The default budget of the encoded data tier, compressed images are ~10-30x smaller than their bitmaps
+static const NSUInteger kYSCDefaultMaxMemoryDataCost = 16 * 1024 * 1024; // 16 MB
+
+// The number of disk results of a batched query delivered together to the main queue
+static const NSUInteger kYSCBatchQueryDeliveryCount = 8;
+
+// The number of images evicted per maintenance block, so a trim never holds the disk for long
+static const NSUInteger kYSCDiskCacheTrimStepCount = 16;
+
+// The hot set file is a header followed by the records, most recently used first
+static const uint32_t kYSCHotSetMagic = 0x31485359; // "YSH1", bump the last digit when the record changes
+static const NSUInteger kYSCHotSetMaxCount = 256;
+
+typedef struct YSCHotSetHeader {
+    uint32_t magic;
+    uint32_t count;
+} YSCHotSetHeader;
+
+// Every record is followed by the UTF-8 key
+typedef struct YSCHotSetRecord {
+    uint32_t keyLength;
+    uint32_t cost;
+} YSCHotSetRecord;
+
+// Set on every IO queue of every cache, to tell them apart from other queues
+static void *kYSCImageCacheIOQueueKey = &kYSCImageCacheIOQueueKey;
+static void *kYSCImageCacheConfigContext = &kYSCImageCacheConfigContext;
+
+@interface YSCImageCacheQueryResult ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *key;
+@property (nonatomic, strong, readwrite, nullable) UIImage *image;
+@property (nonatomic, strong, readwrite, nullable) NSData *data;
+@property (nonatomic, assign, readwrite) YSCImageCacheType cacheType;
+
 @end
 
+@implementation YSCImageCacheQueryResult
 
-FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
-#if YSC_MAC
-    return image.size.height * image.size.width;
-#elif YSC_UIKIT || YSC_WATCH
-    return image.size.height * image.size.width * image.scale * image.scale;
-#endif
++ (nonnull instancetype)resultWithKey:(nonnull NSString *)key image:(nullable UIImage *)image data:(nullable NSData *)data cacheType:(YSCImageCacheType)cacheType {
+    YSCImageCacheQueryResult *result = [self new];
+    result.key = key;
+    result.image = image;
+    result.data = data;
+    result.cacheType = cacheType;
+    return result;
 }
 
+@end
+
+// A store waiting in the write buffer
+@interface YSCImageCachePendingWrite : NSObject
+
+@property (strong, nonatomic, nonnull) YSCImageCacheKey *cacheKey;
+// The data to write, nil until the image is encoded
+@property (strong, nonatomic, nullable) NSData *data;
+@property (strong, nonatomic, nonnull) NSMutableArray<YSCWebImageNoParamsBlock> *completionBlocks;
+// Set once the write has been handed to its IO queue
+@property (assign, nonatomic, getter=isFlushing) BOOL flushing;
+// In seconds since 1970, 0 follows the max cache age of the config
+@property (assign, nonatomic) NSTimeInterval expirationTime;
+
+@end
+
+@implementation YSCImageCachePendingWrite
+@end
+
 @interface YSCImageCache ()
 
 #pragma mark - Properties
-@property (strong, nonatomic, nonnull) NSCache *memCache;
+@property (strong, nonatomic, nonnull) YSCMemoryCache *memCache;
+// Encoded data tier, the compressed data of the recently used images
+@property (strong, nonatomic, nonnull) YSCMemoryCache *dataMemCache;
 @property (strong, nonatomic, nonnull) NSString *diskCachePath;
 @property (strong, nonatomic, nullable) NSMutableArray<NSString *> *customPaths;
-@property (strong, nonatomic, nullable) dispatch_queue_t ioQueue;
+// One concurrent queue per shard. Reads and writes run concurrently, removals and renames are barriers of the key's shard
+@property (strong, nonatomic, nullable) NSArray<dispatch_queue_t> *ioQueues;
+// One serial queue per shard targeting its IO queue, keeping the writes of a key in order without blocking the reads
+@property (strong, nonatomic, nullable) NSArray<dispatch_queue_t> *writeQueues;
+// Serial queue running the cleanups and the cache info at background priority
+@property (strong, nonatomic, nonnull) dispatch_queue_t maintenanceQueue;
+@property (strong, nonatomic, nullable) YSCImageCachePackStorage *packStorage;
+@property (strong, nonatomic, nonnull) YSCImageCacheIndex *diskIndex;
+// Negative lookup filters, of the indexed files of the default directory and of each read only directory
+@property (strong, nonatomic, nonnull) YSCImageCacheFilter *diskFilter;
+@property (strong, nonatomic, nonnull) YSCImageCacheMetricsRecorder *metricsRecorder;
+// Set while a trace is recorded, read without locking by every query and store
+@property (strong, atomic, nullable) YSCImageCacheTraceRecorder *traceRecorder;
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSString *, YSCImageCacheFilter *> *customPathFilters;
+// The write buffer, by key. A write stays here until it's on disk, so the reads can find it.
+@property (strong, nonatomic, nonnull) NSMutableDictionary<NSString *, YSCImageCachePendingWrite *> *pendingWrites;
+// Encodes the images stored without data, created on first use
+@property (strong, nonatomic, nullable) NSOperationQueue *encodeQueue;
 
 @end
 
 
 @implementation YSCImageCache {
     NSFileManager *_fileManager;
+    _Atomic(uint64_t) _diskQueryCount;
+    _Atomic(uint64_t) _fileReadAttempts;
+    _Atomic(uint64_t) _bytesRead;
+    _Atomic(uint64_t) _bytesMapped;
+    _Atomic(uint64_t) _quarantinedFileCount;
+    _Atomic(bool) _diskCacheTrimming;
+    _Atomic(uint64_t) _dataHitCount;
+    _Atomic(bool) _diskFilterRebuilding;
+    // The eviction count of the memory cache when the metrics were last reset
+    _Atomic(uint64_t) _metricsMemoryEvictionBase;
+    // Guarded by the pending writes
+    NSUInteger _pendingWriteCount;
+    NSUInteger _pendingWriteBytes;
+    BOOL _pendingWriteFlushScheduled;
+    // Only touched from the IO queues
+    BOOL _diskCacheDirectoryReady;
+    dispatch_source_t _memoryPressureSource;
 }
 
 #pragma mark - Singleton, init, dealloc
@@ -84,14 +227,24 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
     if ((self = [super init])) {
         NSString *fullNamespace = [@"com.hackemist.YSCWebImageCache." stringByAppendingString:ns];
         
-        // Create IO serial queue
-        _ioQueue = dispatch_queue_create("com.hackemist.YSCWebImageCache", DISPATCH_QUEUE_SERIAL);
+        // Create the maintenance serial queue, the IO queues are created on first use so the shard count can be configured
+        _maintenanceQueue = dispatch_queue_create("com.hackemist.YSCWebImageCache.maintenance", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_maintenanceQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+        dispatch_queue_set_specific(_maintenanceQueue, kYSCImageCacheIOQueueKey, kYSCImageCacheIOQueueKey, NULL);
         
         _config = [[YSCImageCacheConfig alloc] init];
         
         // Init the memory cache
-        _memCache = [[YSCAutoPurgeCache alloc] init];
+        _memCache = [[YSCMemoryCache alloc] init];
         _memCache.name = fullNamespace;
+        _dataMemCache = [[YSCMemoryCache alloc] init];
+        _dataMemCache.name = [fullNamespace stringByAppendingString:@".data"];
+        _dataMemCache.totalCostLimit = kYSCDefaultMaxMemoryDataCost;
+        // The eviction policy is applied to the memory caches when it's set on the config, and now
+        [_config addObserver:self
+                  forKeyPath:NSStringFromSelector(@selector(memoryCacheEvictionPolicy))
+                     options:NSKeyValueObservingOptionInitial
+                     context:kYSCImageCacheConfigContext];
 
         // Init the disk cache
         if (directory != nil) {
@@ -101,14 +254,40 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
             _diskCachePath = path;
         }
 
-        dispatch_sync(_ioQueue, ^{
-            _fileManager = [NSFileManager new];
+        // The index lives in the cache directory as a hidden file, so clearing the directory also clears it
+        NSString *indexPath = [_diskCachePath stringByAppendingPathComponent:@".YSCImageCacheIndex"];
+        _diskIndex = [[YSCImageCacheIndex alloc] initWithPath:indexPath directory:_diskCachePath];
+        _diskFilter = [YSCImageCacheFilter new];
+        _metricsRecorder = [YSCImageCacheMetricsRecorder new];
+        _customPathFilters = [NSMutableDictionary new];
+        _pendingWrites = [NSMutableDictionary new];
+
+        _fileManager = [NSFileManager new];
+
+        // Load the index early, so the first query of the cache info doesn't pay for it, and build the filter from it
+        atomic_store(&_diskFilterRebuilding, true);
+        dispatch_async(_maintenanceQueue, ^{
+            [self rebuildDiskFilter];
+        });
+
+        // The memory caches don't purge themselves like NSCache, trim them when the system runs low on memory. This
+        // works on every platform, not only where UIKit posts memory warnings.
+        _memoryPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                       DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                       dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0));
+        __weak typeof(self) weakSelf = self;
+        dispatch_source_set_event_handler(_memoryPressureSource, ^{
+            YSCImageCache *strongSelf = weakSelf;
+            if (strongSelf) {
+                [strongSelf didReceiveMemoryPressure:dispatch_source_get_data(strongSelf->_memoryPressureSource)];
+            }
         });
+        dispatch_resume(_memoryPressureSource);
 
 #if YSC_UIKIT
         // Subscribe to app events
         [[NSNotificationCenter defaultCenter] addObserver:self
-                                                 selector:@selector(clearMemory)
+                                                 selector:@selector(didReceiveMemoryWarning)
                                                      name:UIApplicationDidReceiveMemoryWarningNotification
                                                    object:nil];
 
@@ -128,17 +307,100 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
 }
 
 - (void)dealloc {
+    dispatch_source_cancel(_memoryPressureSource);
     [[NSNotificationCenter defaultCenter] removeObserver:self];
+    [_config removeObserver:self forKeyPath:NSStringFromSelector(@selector(memoryCacheEvictionPolicy)) context:kYSCImageCacheConfigContext];
+}
+
+- (void)observeValueForKeyPath:(nullable NSString *)keyPath ofObject:(nullable id)object change:(nullable NSDictionary<NSKeyValueChangeKey, id> *)change context:(nullable void *)context {
+    if (context != kYSCImageCacheConfigContext) {
+        [super observeValueForKeyPath:keyPath ofObject:object change:change context:context];
+        return;
+    }
+    YSCMemoryCacheEvictionPolicy evictionPolicy = [self memoryCacheEvictionPolicy];
+    _memCache.evictionPolicy = evictionPolicy;
+    _dataMemCache.evictionPolicy = evictionPolicy;
 }
 
 - (void)checkIfQueueIsIOQueue {
-    const char *currentQueueLabel = dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL);
-    const char *ioQueueLabel = dispatch_queue_get_label(self.ioQueue);
-    if (strcmp(currentQueueLabel, ioQueueLabel) != 0) {
+    if (dispatch_get_specific(kYSCImageCacheIOQueueKey) == NULL) {
         NSLog(@"This method should be called from the ioQueue");
     }
 }
 
+#pragma mark - IO queues
+
+- (nonnull NSArray<dispatch_queue_t> *)ioQueues {
+    @synchronized (self) {
+        if (!_ioQueues) {
+            NSUInteger shardCount = MAX(self.config.diskCacheShardCount, 1);
+            NSMutableArray<dispatch_queue_t> *ioQueues = [NSMutableArray arrayWithCapacity:shardCount];
+            NSMutableArray<dispatch_queue_t> *writeQueues = [NSMutableArray arrayWithCapacity:shardCount];
+            for (NSUInteger i = 0; i < shardCount; i++) {
+                NSString *label = [NSString stringWithFormat:@"com.hackemist.YSCWebImageCache.shard%lu", (unsigned long)i];
+                dispatch_queue_t ioQueue = dispatch_queue_create(label.UTF8String, DISPATCH_QUEUE_CONCURRENT);
+                dispatch_queue_set_specific(ioQueue, kYSCImageCacheIOQueueKey, kYSCImageCacheIOQueueKey, NULL);
+                [ioQueues addObject:ioQueue];
+
+                NSString *writeLabel = [label stringByAppendingString:@".write"];
+                dispatch_queue_t writeQueue = dispatch_queue_create(writeLabel.UTF8String, DISPATCH_QUEUE_SERIAL);
+                dispatch_set_target_queue(writeQueue, ioQueue);
+                [writeQueues addObject:writeQueue];
+            }
+            _ioQueues = [ioQueues copy];
+            _writeQueues = [writeQueues copy];
+        }
+        return _ioQueues;
+    }
+}
+
+- (nonnull NSArray<dispatch_queue_t> *)writeQueues {
+    // created along with the IO queues
+    [self ioQueues];
+    return _writeQueues;
+}
+
+- (nonnull dispatch_queue_t)ioQueueForCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    return self.ioQueues[[self ioQueueIndexForCacheKey:cacheKey]];
+}
+
+// The digest spreads the keys evenly, unlike the string hash which only looks at a few characters of long URLs
+- (NSUInteger)ioQueueIndexForCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    return (NSUInteger)(cacheKey.digest.low % self.ioQueues.count);
+}
+
+// The shard of the key an indexed file is named after, so the work on the file is ordered with the stores of the key
+- (nonnull dispatch_queue_t)ioQueueForIndexEntry:(nonnull YSCImageCacheIndexEntry *)entry {
+    NSArray<dispatch_queue_t> *ioQueues = self.ioQueues;
+    YSCImageCacheKeyDigest digest;
+    if (![YSCImageCacheFilter getDigest:&digest fromFileName:entry.fileName]) {
+        // not named after a digest, no store writes it
+        return ioQueues[0];
+    }
+    return ioQueues[(NSUInteger)(digest.low % ioQueues.count)];
+}
+
+// Run the block on the maintenance queue once every shard has drained the work queued before,
+// no shard runs anything while the block runs.
+- (void)dispatchBarrierOnAllIOQueues:(nonnull dispatch_block_t)block {
+    NSArray<dispatch_queue_t> *ioQueues = self.ioQueues;
+    dispatch_group_t drainedGroup = dispatch_group_create();
+    dispatch_semaphore_t resumeSemaphore = dispatch_semaphore_create(0);
+    for (dispatch_queue_t ioQueue in ioQueues) {
+        dispatch_group_enter(drainedGroup);
+        dispatch_barrier_async(ioQueue, ^{
+            dispatch_group_leave(drainedGroup);
+            dispatch_semaphore_wait(resumeSemaphore, DISPATCH_TIME_FOREVER);
+        });
+    }
+    dispatch_group_notify(drainedGroup, self.maintenanceQueue, ^{
+        block();
+        for (NSUInteger i = 0; i < ioQueues.count; i++) {
+            dispatch_semaphore_signal(resumeSemaphore);
+        }
+    });
+}
+
 #pragma mark - Cache paths
 
 - (void)addReadOnlyCachePath:(nonnull NSString *)path {
@@ -148,38 +410,48 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
 
     if (![self.customPaths containsObject:path]) {
         [self.customPaths addObject:path];
+
+        // The read only directories don't change, their filter is built once
+        YSCImageCacheFilter *filter = [YSCImageCacheFilter new];
+        @synchronized (self.customPathFilters) {
+            self.customPathFilters[path] = filter;
+        }
+        dispatch_async(self.maintenanceQueue, ^{
+            [filter beginBuilding];
+            NSArray<NSString *> *fileNames = [_fileManager contentsOfDirectoryAtPath:path error:nil];
+            [filter finishBuildingWithDigests:[YSCImageCache digestsOfFileNames:fileNames]];
+        });
     }
 }
 
 - (nullable NSString *)cachePathForKey:(nullable NSString *)key inPath:(nonnull NSString *)path {
-    NSString *filename = [self cachedFileNameForKey:key];
-    return [path stringByAppendingPathComponent:filename];
+    return [path stringByAppendingPathComponent:[YSCImageCacheKey keyWithString:key].fileName];
 }
 
 - (nullable NSString *)defaultCachePathForKey:(nullable NSString *)key {
     return [self cachePathForKey:key inPath:self.diskCachePath];
 }
 
-- (nullable NSString *)cachedFileNameForKey:(nullable NSString *)key {
-    const char *str = key.UTF8String;
-    if (str == NULL) {
-        str = "";
-    }
-    unsigned char r[CC_MD5_DIGEST_LENGTH];
-    CC_MD5(str, (CC_LONG)strlen(str), r);
-    NSURL *keyURL = [NSURL URLWithString:key];
-    NSString *ext = keyURL ? keyURL.pathExtension : key.pathExtension;
-    NSString *filename = [NSString stringWithFormat:@"%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%02x%@",
-                          r[0], r[1], r[2], r[3], r[4], r[5], r[6], r[7], r[8], r[9], r[10],
-                          r[11], r[12], r[13], r[14], r[15], ext.length == 0 ? @"" : [NSString stringWithFormat:@".%@", ext]];
-    return filename;
-}
-
 - (nullable NSString *)makeDiskCachePath:(nonnull NSString*)fullNamespace {
     NSArray<NSString *> *paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
     return [paths[0] stringByAppendingPathComponent:fullNamespace];
 }
 
+// The pack storage is created on first use, so the layout can be changed on the config after init
+- (nullable YSCImageCachePackStorage *)packStorage {
+    if (self.config.diskCacheLayout != YSCImageCacheDiskLayoutPackFile) {
+        return nil;
+    }
+    @synchronized (self) {
+        if (!_packStorage) {
+            NSString *directory = [self.diskCachePath stringByAppendingPathExtension:@"pack"];
+            _packStorage = [[YSCImageCachePackStorage alloc] initWithDirectory:directory segmentSize:self.config.diskCachePackSegmentSize];
+            _packStorage.shouldDisableiCloud = self.config.shouldDisableiCloud;
+        }
+        return _packStorage;
+    }
+}
+
 #pragma mark - Store Ops
 
 - (void)storeImage:(nullable UIImage *)image
@@ -200,41 +472,49 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
             forKey:(nullable NSString *)key
             toDisk:(BOOL)toDisk
         completion:(nullable YSCWebImageNoParamsBlock)completionBlock {
+    [self storeImage:image imageData:imageData forKey:key toDisk:toDisk maxAge:0 completion:completionBlock];
+}
+
+- (void)storeImage:(nullable UIImage *)image
+         imageData:(nullable NSData *)imageData
+            forKey:(nullable NSString *)key
+            toDisk:(BOOL)toDisk
+            maxAge:(NSTimeInterval)maxAge
+        completion:(nullable YSCWebImageNoParamsBlock)completionBlock {
     if (!image || !key) {
         if (completionBlock) {
             completionBlock();
         }
         return;
     }
+    NSTimeInterval expirationTime = maxAge > 0 ? [[NSDate date] timeIntervalSince1970] + maxAge : 0;
+    YSCImageCacheTraceRecorder *traceRecorder = self.traceRecorder;
+    if (traceRecorder) {
+        uint64_t startTime = mach_absolute_time();
+        NSUInteger size = imageData.length ?: YSCCacheCostForImage(image);
+        YSCWebImageNoParamsBlock tracedCompletionBlock = completionBlock;
+        completionBlock = ^{
+            [traceRecorder recordOperation:YSCImageCacheTraceOperationStore key:key size:size tier:YSCImageCacheTraceTierNone startTime:startTime];
+            if (tracedCompletionBlock) {
+                tracedCompletionBlock();
+            }
+        };
+    }
     // if memory cache is enabled
     if (self.config.shouldCacheImagesInMemory) {
-        NSUInteger cost = YSCCacheCostForImage(image);
-        [self.memCache setObject:image forKey:key cost:cost];
+        YSCSetImageDataForAnimatedImage(image, imageData);
+        [self storeImageToMemory:image forKey:key expirationTime:expirationTime];
+        // the data of an animated image is already counted in its cost
+        if (!YSCImageDataForAnimatedImage(image)) {
+            [self storeImageDataToMemory:imageData forKey:key expirationTime:expirationTime];
+        }
     }
     
     if (toDisk) {
-        dispatch_async(self.ioQueue, ^{
-            @autoreleasepool {
-                NSData *data = imageData;
-                if (!data && image) {
-                    // If we do not have any data to detect image format, check whether it contains alpha channel to use PNG or JPEG format
-                    YSCImageFormat format;
-                    if (YSCCGImageRefContainsAlpha(image.CGImage)) {
-                        format = YSCImageFormatPNG;
-                    } else {
-                        format = YSCImageFormatJPEG;
-                    }
-                    data = [[YSCWebImageCodersManager sharedInstance] encodedDataWithImage:image format:format];
-                }
-                [self storeImageDataToDisk:data forKey:key];
-            }
-            
-            if (completionBlock) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    completionBlock();
-                });
-            }
-        });
+        YSCImageCachePendingWrite *write = [self enqueueWriteOfImageData:imageData forKey:key expirationTime:expirationTime completion:completionBlock];
+        if (!imageData) {
+            [self encodeImage:image forPendingWrite:write];
+        }
     } else {
         if (completionBlock) {
             completionBlock();
@@ -246,200 +526,1133 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
     if (!imageData || !key) {
         return;
     }
+    [self storeImageDataToDisk:imageData forCacheKey:[YSCImageCacheKey keyWithString:key]];
+}
+
+- (void)storeImageDataToDisk:(nullable NSData *)imageData forCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    if (!imageData) {
+        return;
+    }
     
     [self checkIfQueueIsIOQueue];
     
+    [self prepareDiskCacheDirectory];
+    [self writeImageDataToDisk:imageData forCacheKey:cacheKey expirationTime:0];
+    [self trimDiskCacheIfNeeded];
+}
+
+// Must be called from an IO queue. Done once per batch of writes rather than once per file.
+- (void)prepareDiskCacheDirectory {
+    if (self.packStorage) {
+        return;
+    }
+    @synchronized (self.pendingWrites) {
+        if (_diskCacheDirectoryReady && [_fileManager fileExistsAtPath:_diskCachePath]) {
+            return;
+        }
+        _diskCacheDirectoryReady = YES;
+    }
     if (![_fileManager fileExistsAtPath:_diskCachePath]) {
         [_fileManager createDirectoryAtPath:_diskCachePath withIntermediateDirectories:YES attributes:nil error:NULL];
     }
+    // disable iCloud backup, for the whole directory so the files don't need it one by one
+    if (self.config.shouldDisableiCloud) {
+        [[NSURL fileURLWithPath:_diskCachePath isDirectory:YES] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+    }
+}
+
+// Must be called from the IO queue of the key, after `prepareDiskCacheDirectory`
+- (void)writeImageDataToDisk:(nonnull NSData *)imageData
+                 forCacheKey:(nonnull YSCImageCacheKey *)cacheKey
+              expirationTime:(NSTimeInterval)expirationTime {
+    YSCImageCacheMetricsRecorder *metricsRecorder = self.activeMetricsRecorder;
+    uint64_t startTime = mach_absolute_time();
+    [metricsRecorder addValue:imageData.length toCounter:YSCImageCacheMetricsCounterBytesWritten];
+    YSCImageCachePackStorage *packStorage = self.packStorage;
+    if (packStorage) {
+        [packStorage storeData:imageData forKey:cacheKey.key];
+        [metricsRecorder recordOperation:YSCImageCacheMetricsOperationStore startTime:startTime];
+        return;
+    }
     
     // get cache Path for image key
-    NSString *cachePathForKey = [self defaultCachePathForKey:key];
-    // transform to NSUrl
-    NSURL *fileURL = [NSURL fileURLWithPath:cachePathForKey];
+    NSString *cachePathForKey = [_diskCachePath stringByAppendingPathComponent:cacheKey.fileName];
     
-    [_fileManager createFileAtPath:cachePathForKey contents:imageData attributes:nil];
+    // Index the file before writing it, a crash in between leaves an entry without file rather than an untracked file
+    NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+    YSCImageCacheIndexEntry *entry = [YSCImageCacheIndexEntry new];
+    entry.fileName = cacheKey.fileName;
+    entry.key = cacheKey.key;
+    entry.size = imageData.length;
+    entry.modificationTime = now;
+    entry.accessTime = now;
+    entry.expirationTime = expirationTime;
+    entry.checksum = YSCImageCacheChecksumMake(imageData);
+    [self setIndexEntry:entry];
     
-    // disable iCloud backup
-    if (self.config.shouldDisableiCloud) {
-        [fileURL setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+    // Written to a temporary file and renamed, so a file mapped by a reader is never modified
+    if (![imageData writeToFile:cachePathForKey options:NSDataWritingAtomic error:nil]) {
+        [self removeIndexEntryForFileName:entry.fileName];
     }
+    [metricsRecorder recordOperation:YSCImageCacheMetricsOperationStore startTime:startTime];
 }
 
-#pragma mark - Query and Retrieve Ops
-
-- (void)diskImageExistsWithKey:(nullable NSString *)key completion:(nullable YSCWebImageCheckCacheCompletionBlock)completionBlock {
-    dispatch_async(_ioQueue, ^{
-        BOOL exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key]];
-
-        // fallback because of https://github.com/rs/YSCWebImage/pull/976 that added the extension to the disk file name
-        // checking the key with and without the extension
-        if (!exists) {
-            exists = [_fileManager fileExistsAtPath:[self defaultCachePathForKey:key].stringByDeletingPathExtension];
-        }
+#pragma mark - Encoding
 
-        if (completionBlock) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                completionBlock(exists);
-            });
+// Encoding runs on its own bounded pool, the IO queues only get the encoded bytes
+- (void)encodeImage:(nonnull UIImage *)image forPendingWrite:(nonnull YSCImageCachePendingWrite *)write {
+    NSOperationQueue *encodeQueue = self.encodeQueue;
+    encodeQueue.maxConcurrentOperationCount = MAX(self.config.diskCacheEncodeConcurrency, 1);
+    [encodeQueue addOperationWithBlock:^{
+        @autoreleasepool {
+            NSData *data = nil;
+            // stored again or removed meanwhile
+            if ([self isCurrentPendingWrite:write]) {
+                data = [self encodedDataWithImage:image];
+                // the image is in the memory cache already, its data goes to the data tier
+                if (data && self.config.shouldCacheImagesInMemory) {
+                    [self storeImageDataToMemory:data forKey:write.cacheKey.key];
+                }
+            }
+            [self finishEncodingOfPendingWrite:write data:data];
         }
-    });
-}
-
-- (nullable UIImage *)imageFromMemoryCacheForKey:(nullable NSString *)key {
-    return [self.memCache objectForKey:key];
+    }];
 }
 
-- (nullable UIImage *)imageFromDiskCacheForKey:(nullable NSString *)key {
-    UIImage *diskImage = [self diskImageForKey:key];
-    if (diskImage && self.config.shouldCacheImagesInMemory) {
-        NSUInteger cost = YSCCacheCostForImage(diskImage);
-        [self.memCache setObject:diskImage forKey:key cost:cost];
+- (nullable NSData *)encodedDataWithImage:(nonnull UIImage *)image {
+    YSCImageFormat format = self.config.diskCacheEncodeFormat;
+    YSCWebImageCodersManager *codersManager = [YSCWebImageCodersManager sharedInstance];
+    if (format == YSCImageFormatUndefined || ![codersManager canEncodeToFormat:format]) {
+        // If we do not have any data to detect image format, check whether it contains alpha channel to use PNG or JPEG format
+        if (YSCCGImageRefContainsAlpha(image.CGImage)) {
+            format = YSCImageFormatPNG;
+        } else {
+            format = YSCImageFormatJPEG;
+        }
     }
-
-    return diskImage;
+    NSDictionary<NSString *, NSObject *> *options = @{YSCWebImageCoderEncodeCompressionQualityKey: @(self.config.diskCacheEncodeQuality)};
+    return [codersManager encodedDataWithImage:image format:format options:options];
 }
 
-- (nullable UIImage *)imageFromCacheForKey:(nullable NSString *)key {
-    // First check the in-memory cache...
-    UIImage *image = [self imageFromMemoryCacheForKey:key];
-    if (image) {
-        return image;
+- (nonnull NSOperationQueue *)encodeQueue {
+    @synchronized (self) {
+        if (!_encodeQueue) {
+            _encodeQueue = [NSOperationQueue new];
+            _encodeQueue.name = @"com.hackemist.YSCWebImageCache.encode";
+            _encodeQueue.qualityOfService = NSQualityOfServiceUtility;
+        }
+        return _encodeQueue;
     }
-    
-    // Second check the disk cache...
-    image = [self imageFromDiskCacheForKey:key];
-    return image;
 }
 
-- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key {
-    NSString *defaultPath = [self defaultCachePathForKey:key];
-    NSData *data = [NSData dataWithContentsOfFile:defaultPath options:self.config.diskCacheReadingOptions error:nil];
-    if (data) {
-        return data;
+#pragma mark - Write buffer
+
+// `imageData` is nil when the image has to be encoded first, the write then waits in the buffer without being flushed
+- (nonnull YSCImageCachePendingWrite *)enqueueWriteOfImageData:(nullable NSData *)imageData
+                                                        forKey:(nonnull NSString *)key
+                                                expirationTime:(NSTimeInterval)expirationTime
+                                                    completion:(nullable YSCWebImageNoParamsBlock)completionBlock {
+    YSCImageCachePendingWrite *write = [YSCImageCachePendingWrite new];
+    write.cacheKey = [YSCImageCacheKey keyWithString:key];
+    write.data = imageData;
+    write.expirationTime = expirationTime;
+    write.completionBlocks = [NSMutableArray array];
+
+    @synchronized (self.pendingWrites) {
+        YSCImageCachePendingWrite *replacedWrite = self.pendingWrites[key];
+        if (replacedWrite && !replacedWrite.isFlushing) {
+            // Only the last store of the key is written, the completions of the replaced one wait for it
+            [write.completionBlocks addObjectsFromArray:replacedWrite.completionBlocks];
+            [self removeFlushableWrite:replacedWrite];
+        }
+        if (completionBlock) {
+            [write.completionBlocks addObject:completionBlock];
+        }
+        self.pendingWrites[key] = write;
     }
-
-    // fallback because of https://github.com/rs/YSCWebImage/pull/976 that added the extension to the disk file name
-    // checking the key with and without the extension
-    data = [NSData dataWithContentsOfFile:defaultPath.stringByDeletingPathExtension options:self.config.diskCacheReadingOptions error:nil];
-    if (data) {
-        return data;
+    if (imageData) {
+        [self addFlushableWrite:write];
     }
+    return write;
+}
 
-    NSArray<NSString *> *customPaths = [self.customPaths copy];
-    for (NSString *path in customPaths) {
-        NSString *filePath = [self cachePathForKey:key inPath:path];
-        NSData *imageData = [NSData dataWithContentsOfFile:filePath options:self.config.diskCacheReadingOptions error:nil];
-        if (imageData) {
-            return imageData;
+- (void)finishEncodingOfPendingWrite:(nonnull YSCImageCachePendingWrite *)write data:(nullable NSData *)data {
+    NSArray<YSCWebImageNoParamsBlock> *completionBlocks = nil;
+    @synchronized (self.pendingWrites) {
+        if (self.pendingWrites[write.cacheKey.key] != write) {
+            // the completions were handed to the newer store, or called by the removal
+            return;
         }
-
-        // fallback because of https://github.com/rs/YSCWebImage/pull/976 that added the extension to the disk file name
-        // checking the key with and without the extension
-        imageData = [NSData dataWithContentsOfFile:filePath.stringByDeletingPathExtension options:self.config.diskCacheReadingOptions error:nil];
-        if (imageData) {
-            return imageData;
+        write.data = data;
+        if (!data) {
+            [self.pendingWrites removeObjectForKey:write.cacheKey.key];
+            completionBlocks = write.completionBlocks;
         }
     }
-
-    return nil;
-}
-
-- (nullable UIImage *)diskImageForKey:(nullable NSString *)key {
-    NSData *data = [self diskImageDataBySearchingAllPathsForKey:key];
     if (data) {
-        UIImage *image = [[YSCWebImageCodersManager sharedInstance] decodedImageWithData:data];
-        image = [self scaledImageForKey:key image:image];
-        if (self.config.shouldDecompressImages) {
-            image = [[YSCWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&data options:@{YSCWebImageCoderScaleDownLargeImagesKey: @(NO)}];
-        }
-        return image;
+        [self addFlushableWrite:write];
     } else {
-        return nil;
+        [self callCompletionBlocksOnMainQueue:completionBlocks];
     }
 }
 
-- (nullable UIImage *)scaledImageForKey:(nullable NSString *)key image:(nullable UIImage *)image {
-    return YSCScaledImageForKey(key, image);
+- (BOOL)isCurrentPendingWrite:(nonnull YSCImageCachePendingWrite *)write {
+    @synchronized (self.pendingWrites) {
+        return self.pendingWrites[write.cacheKey.key] == write;
+    }
 }
 
-- (nullable NSOperation *)queryCacheOperationForKey:(nullable NSString *)key done:(nullable YSCCacheQueryCompletedBlock)doneBlock {
-    if (!key) {
-        if (doneBlock) {
-            doneBlock(nil, nil, YSCImageCacheTypeNone);
+// Count a write that has its data toward the flush thresholds, and flush or schedule a flush
+- (void)addFlushableWrite:(nonnull YSCImageCachePendingWrite *)write {
+    BOOL flushNow = NO;
+    BOOL scheduleFlush = NO;
+    @synchronized (self.pendingWrites) {
+        _pendingWriteCount++;
+        _pendingWriteBytes += write.data.length;
+
+        NSTimeInterval delay = self.config.diskCacheWriteDelay;
+        if (delay <= 0 || _pendingWriteCount >= self.config.diskCacheWriteBatchCount || _pendingWriteBytes >= self.config.diskCacheWriteBatchSize) {
+            flushNow = YES;
+        } else if (!_pendingWriteFlushScheduled) {
+            _pendingWriteFlushScheduled = YES;
+            scheduleFlush = YES;
         }
-        return nil;
     }
 
-    // First check the in-memory cache...
-    UIImage *image = [self imageFromMemoryCacheForKey:key];
-    if (image) {
-        NSData *diskData = nil;
-        if (image.images) {
-            diskData = [self diskImageDataBySearchingAllPathsForKey:key];
+    if (flushNow) {
+        [self flushPendingWrites];
+    } else if (scheduleFlush) {
+        __weak typeof(self) weakSelf = self;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.config.diskCacheWriteDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            [weakSelf flushPendingWrites];
+        });
+    }
+}
+
+// Must be called with the pending writes locked
+- (void)removeFlushableWrite:(nonnull YSCImageCachePendingWrite *)write {
+    if (write.data && !write.isFlushing) {
+        _pendingWriteCount--;
+        _pendingWriteBytes -= write.data.length;
+    }
+}
+
+- (void)flushPendingWrites {
+    NSMutableArray<NSMutableArray<YSCImageCachePendingWrite *> *> *writesByQueue = nil;
+    NSUInteger queueCount = self.ioQueues.count;
+    @synchronized (self.pendingWrites) {
+        _pendingWriteFlushScheduled = NO;
+        if (_pendingWriteCount == 0) {
+            return;
         }
-        if (doneBlock) {
-            doneBlock(image, diskData, YSCImageCacheTypeMemory);
+        writesByQueue = [NSMutableArray arrayWithCapacity:queueCount];
+        for (NSUInteger i = 0; i < queueCount; i++) {
+            [writesByQueue addObject:[NSMutableArray array]];
         }
-        return nil;
+        for (YSCImageCachePendingWrite *write in self.pendingWrites.allValues) {
+            // the writes still being encoded stay in the buffer
+            if (write.data && !write.isFlushing) {
+                write.flushing = YES;
+                [writesByQueue[[self ioQueueIndexForCacheKey:write.cacheKey]] addObject:write];
+            }
+        }
+        _pendingWriteCount = 0;
+        _pendingWriteBytes = 0;
     }
 
-    NSOperation *operation = [NSOperation new];
-    dispatch_async(self.ioQueue, ^{
-        if (operation.isCancelled) {
-            // do not call the completion if cancelled
-            return;
+    for (NSUInteger i = 0; i < queueCount; i++) {
+        NSArray<YSCImageCachePendingWrite *> *writes = writesByQueue[i];
+        if (writes.count == 0) {
+            continue;
         }
+        // The files are written to a temporary file and renamed, so the reads of the shard don't need to wait
+        dispatch_async(self.writeQueues[i], [self measuredIOQueueBlock:^{
+            [self writePendingWrites:writes];
+        }]);
+    }
+}
+
+// Must be called from the IO queue of the writes
+- (void)writePendingWrites:(nonnull NSArray<YSCImageCachePendingWrite *> *)writes {
+    [self prepareDiskCacheDirectory];
 
+    NSMutableArray<YSCWebImageNoParamsBlock> *completionBlocks = [NSMutableArray array];
+    for (YSCImageCachePendingWrite *write in writes) {
         @autoreleasepool {
-            NSData *diskData = [self diskImageDataBySearchingAllPathsForKey:key];
-            UIImage *diskImage = [self diskImageForKey:key];
-            if (diskImage && self.config.shouldCacheImagesInMemory) {
-                NSUInteger cost = YSCCacheCostForImage(diskImage);
-                [self.memCache setObject:diskImage forKey:key cost:cost];
+            // removed, or stored again and written by a later batch
+            if ([self isCurrentPendingWrite:write]) {
+                [self writeImageDataToDisk:write.data forCacheKey:write.cacheKey expirationTime:write.expirationTime];
             }
 
-            if (doneBlock) {
-                dispatch_async(dispatch_get_main_queue(), ^{
-                    doneBlock(diskImage, diskData, YSCImageCacheTypeDisk);
-                });
+            @synchronized (self.pendingWrites) {
+                if (self.pendingWrites[write.cacheKey.key] == write) {
+                    [self.pendingWrites removeObjectForKey:write.cacheKey.key];
+                }
             }
         }
-    });
+        [completionBlocks addObjectsFromArray:write.completionBlocks];
+    }
 
-    return operation;
+    [self trimDiskCacheIfNeeded];
+    [self callCompletionBlocksOnMainQueue:completionBlocks];
 }
 
-#pragma mark - Remove Ops
+// The data of a store still waiting in the write buffer
+- (nullable NSData *)pendingWriteDataForKey:(nonnull NSString *)key {
+    @synchronized (self.pendingWrites) {
+        return self.pendingWrites[key].data;
+    }
+}
 
-- (void)removeImageForKey:(nullable NSString *)key withCompletion:(nullable YSCWebImageNoParamsBlock)completion {
-    [self removeImageForKey:key fromDisk:YES withCompletion:completion];
+// Drop the pending write of the key, or all of them for a nil key. Their completions are still called.
+- (void)discardPendingWritesForKey:(nullable NSString *)key {
+    NSMutableArray<YSCWebImageNoParamsBlock> *completionBlocks = [NSMutableArray array];
+    @synchronized (self.pendingWrites) {
+        NSArray<YSCImageCachePendingWrite *> *writes = key ? (self.pendingWrites[key] ? @[self.pendingWrites[key]] : @[]) : self.pendingWrites.allValues;
+        for (YSCImageCachePendingWrite *write in writes) {
+            if (!write.isFlushing) {
+                [self removeFlushableWrite:write];
+                // a flushing write calls its completions once its batch is done
+                [completionBlocks addObjectsFromArray:write.completionBlocks];
+            }
+            [self.pendingWrites removeObjectForKey:write.cacheKey.key];
+        }
+    }
+    [self callCompletionBlocksOnMainQueue:completionBlocks];
 }
 
-- (void)removeImageForKey:(nullable NSString *)key fromDisk:(BOOL)fromDisk withCompletion:(nullable YSCWebImageNoParamsBlock)completion {
-    if (key == nil) {
+- (void)callCompletionBlocksOnMainQueue:(nullable NSArray<YSCWebImageNoParamsBlock> *)completionBlocks {
+    if (completionBlocks.count == 0) {
         return;
     }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        for (YSCWebImageNoParamsBlock completionBlock in completionBlocks) {
+            completionBlock();
+        }
+    });
+}
 
-    if (self.config.shouldCacheImagesInMemory) {
-        [self.memCache removeObjectForKey:key];
-    }
+#pragma mark - Query and Retrieve Ops
 
-    if (fromDisk) {
-        dispatch_async(self.ioQueue, ^{
-            [_fileManager removeItemAtPath:[self defaultCachePathForKey:key] error:nil];
-            
-            if (completion) {
+- (void)diskImageExistsWithKey:(nullable NSString *)key completion:(nullable YSCWebImageCheckCacheCompletionBlock)completionBlock {
+    if (key && [self pendingWriteDataForKey:key]) {
+        if (completionBlock) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionBlock(YES);
+            });
+        }
+        return;
+    }
+    YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+    dispatch_async([self ioQueueForCacheKey:cacheKey], [self measuredIOQueueBlock:^{
+        YSCImageCachePackStorage *packStorage = self.packStorage;
+        if (packStorage) {
+            BOOL exists = key && [packStorage containsDataForKey:key];
+            if (completionBlock) {
                 dispatch_async(dispatch_get_main_queue(), ^{
-                    completion();
+                    completionBlock(exists);
                 });
             }
-        });
-    } else if (completion){
-        completion();
-    }
-    
-}
+            return;
+        }
+
+        BOOL exists = NO;
+        NSArray<NSString *> *fileNames = [self filter:self.diskFilter mayContainCacheKey:cacheKey] ? [self fileNamesForCacheKey:cacheKey] : @[];
+        for (NSString *fileName in fileNames) {
+            if ([_fileManager fileExistsAtPath:[self.diskCachePath stringByAppendingPathComponent:fileName]]) {
+                exists = YES;
+                break;
+            }
+        }
+
+        if (completionBlock) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionBlock(exists);
+            });
+        }
+    }]);
+}
+
+- (nullable UIImage *)imageFromMemoryCacheForKey:(nullable NSString *)key {
+    return [self.memCache objectForKey:key];
+}
+
+- (nullable UIImage *)imageFromDiskCacheForKey:(nullable NSString *)key {
+    NSData *data = [self imageDataFromMemoryCacheForKey:key];
+    if (!data) {
+        data = [self diskImageDataBySearchingAllPathsForCacheKey:[YSCImageCacheKey keyWithString:key]];
+        [self storeImageDataToMemory:data forKey:key];
+    }
+    return [self memoryCachedImageForKey:key data:data];
+}
+
+- (nullable UIImage *)imageFromCacheForKey:(nullable NSString *)key {
+    // First check the in-memory cache...
+    UIImage *image = [self imageFromMemoryCacheForKey:key];
+    if (image) {
+        return image;
+    }
+    
+    // Second check the disk cache...
+    image = [self imageFromDiskCacheForKey:key];
+    return image;
+}
+
+- (nullable NSData *)imageDataFromMemoryCacheForKey:(nullable NSString *)key {
+    if (!key || !self.config.shouldCacheImagesInMemory || !self.config.shouldCacheImageDataInMemory) {
+        return nil;
+    }
+    NSData *data = [self.dataMemCache objectForKey:key];
+    if (data) {
+        atomic_fetch_add_explicit(&_dataHitCount, 1, memory_order_relaxed);
+    }
+    return data;
+}
+
+- (void)storeImageDataToMemory:(nullable NSData *)data forKey:(nullable NSString *)key {
+    if (!data || !key || !self.config.shouldCacheImagesInMemory || !self.config.shouldCacheImageDataInMemory) {
+        return;
+    }
+    [self storeImageDataToMemory:data forKey:key expirationTime:[self diskExpirationTimeForKey:key]];
+}
+
+- (void)storeImageDataToMemory:(nullable NSData *)data forKey:(nullable NSString *)key expirationTime:(NSTimeInterval)expirationTime {
+    if (!data || !key || !self.config.shouldCacheImagesInMemory || !self.config.shouldCacheImageDataInMemory) {
+        return;
+    }
+    [self.dataMemCache setObject:data forKey:key cost:data.length expirationTime:expirationTime];
+}
+
+- (void)storeImageToMemory:(nonnull UIImage *)image forKey:(nonnull NSString *)key expirationTime:(NSTimeInterval)expirationTime {
+    [self.memCache setObject:image forKey:key cost:YSCCacheCostForImage(image) expirationTime:expirationTime];
+}
+
+- (YSCMemoryCacheEvictionPolicy)memoryCacheEvictionPolicy {
+    BOOL sizeAware = self.config.memoryCacheEvictionPolicy == YSCImageCacheEvictionPolicySizeAware;
+    return sizeAware ? YSCMemoryCacheEvictionPolicyGDSF : YSCMemoryCacheEvictionPolicyLRU;
+}
+
+// The expiration time of the image on disk, so the copies kept in memory expire with it
+- (NSTimeInterval)diskExpirationTimeForKey:(nonnull NSString *)key {
+    if (self.packStorage) {
+        return 0;
+    }
+    @synchronized (self.pendingWrites) {
+        YSCImageCachePendingWrite *write = self.pendingWrites[key];
+        if (write) {
+            return write.expirationTime;
+        }
+    }
+    return [self.diskIndex entryForFileName:[YSCImageCacheKey keyWithString:key].fileName].expirationTime;
+}
+
+- (nullable NSData *)diskImageDataAtPath:(nonnull NSString *)path {
+    atomic_fetch_add_explicit(&_fileReadAttempts, 1, memory_order_relaxed);
+    NSUInteger mappingThreshold = self.config.diskCacheMappingThreshold;
+    NSData *data;
+    if (mappingThreshold > 0) {
+        BOOL mapped = NO;
+        data = [self dataWithContentsOfFile:path mappingThreshold:mappingThreshold mapped:&mapped];
+        if (mapped) {
+            atomic_fetch_add_explicit(&_bytesMapped, data.length, memory_order_relaxed);
+        }
+    } else {
+        data = [NSData dataWithContentsOfFile:path options:self.config.diskCacheReadingOptions error:nil];
+    }
+    if (data) {
+        atomic_fetch_add_explicit(&_bytesRead, data.length, memory_order_relaxed);
+        [self.activeMetricsRecorder addValue:data.length toCounter:YSCImageCacheMetricsCounterBytesRead];
+    }
+    return data;
+}
+
+// Map the file when it's at least `mappingThreshold` bytes, or read it in a single buffer.
+// The mapping lives as long as the returned data: the coders and the images they decode lazily retain it.
+// Cache files are never truncated in place, they are replaced by a rename or unlinked, so a mapping stays valid.
+- (nullable NSData *)dataWithContentsOfFile:(nonnull NSString *)path mappingThreshold:(NSUInteger)mappingThreshold mapped:(nonnull BOOL *)mapped {
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return nil;
+    }
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0) {
+        close(fd);
+        return nil;
+    }
+    if (fileStat.st_size == 0) {
+        close(fd);
+        return [NSData data];
+    }
+    size_t length = (size_t)fileStat.st_size;
+
+    if (length >= mappingThreshold) {
+        void *bytes = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (bytes == MAP_FAILED) {
+            return nil;
+        }
+        *mapped = YES;
+        return [[NSData alloc] initWithBytesNoCopy:bytes length:length deallocator:^(void *bytes, NSUInteger length) {
+            munmap(bytes, length);
+        }];
+    }
+
+    void *bytes = malloc(length);
+    size_t offset = 0;
+    while (bytes && offset < length) {
+        ssize_t readLength = read(fd, (uint8_t *)bytes + offset, length - offset);
+        if (readLength <= 0) {
+            if (readLength < 0 && errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        offset += readLength;
+    }
+    close(fd);
+    if (!bytes || offset != length) {
+        free(bytes);
+        return nil;
+    }
+    return [[NSData alloc] initWithBytesNoCopy:bytes length:length freeWhenDone:YES];
+}
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForKey:(nullable NSString *)key {
+    return [self diskImageDataBySearchingAllPathsForCacheKey:[YSCImageCacheKey keyWithString:key]];
+}
+
+- (nullable NSData *)diskImageDataBySearchingAllPathsForCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    // A store not written yet is the most recent data of the key
+    NSData *data = [self pendingWriteDataForKey:cacheKey.key];
+    if (!data) {
+        atomic_fetch_add_explicit(&_diskQueryCount, 1, memory_order_relaxed);
+        data = [self searchDiskImageDataInAllPathsForCacheKey:cacheKey];
+    }
+    [self.activeMetricsRecorder addValue:1 toCounter:data ? YSCImageCacheMetricsCounterDiskHit : YSCImageCacheMetricsCounterDiskMiss];
+    return data;
+}
+
+- (nullable NSData *)searchDiskImageDataInAllPathsForCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    YSCImageCachePackStorage *packStorage = self.packStorage;
+    if (packStorage) {
+        NSData *data = [packStorage dataForKey:cacheKey.key];
+        if (data) {
+            // pack segments are always mapped
+            atomic_fetch_add_explicit(&_bytesRead, data.length, memory_order_relaxed);
+            atomic_fetch_add_explicit(&_bytesMapped, data.length, memory_order_relaxed);
+            [self.activeMetricsRecorder addValue:data.length toCounter:YSCImageCacheMetricsCounterBytesRead];
+            return data;
+        }
+    } else if ([self filter:self.diskFilter mayContainCacheKey:cacheKey]) {
+        NSString *fileName = nil;
+        NSData *data = [self diskImageDataInDirectory:self.diskCachePath cacheKey:cacheKey fileName:&fileName];
+        YSCImageCacheIndexEntry *entry = data ? [self.diskIndex entryForFileName:fileName] : nil;
+        if (entry.expirationTime > 0 && entry.expirationTime <= [[NSDate date] timeIntervalSince1970]) {
+            [self removeExpiredIndexedFile:entry cacheKey:cacheKey];
+            return nil;
+        }
+        if (entry && self.config.shouldVerifyDiskCacheChecksums && ![self isDiskDataSizeValid:data forEntry:entry]) {
+            [self quarantineIndexedFile:entry cacheKey:cacheKey];
+            return nil;
+        }
+        if (data) {
+            if ([fileName isEqualToString:cacheKey.fileName]) {
+                [self.diskIndex touchEntryForFileName:fileName];
+            } else {
+                [self migrateFileName:fileName toFileNameOfCacheKey:cacheKey];
+            }
+            return data;
+        }
+    }
+
+    NSArray<NSString *> *customPaths = [self.customPaths copy];
+    for (NSString *path in customPaths) {
+        YSCImageCacheFilter *filter;
+        @synchronized (self.customPathFilters) {
+            filter = self.customPathFilters[path];
+        }
+        if (filter && ![self filter:filter mayContainCacheKey:cacheKey]) {
+            continue;
+        }
+        NSData *imageData = [self diskImageDataInDirectory:path cacheKey:cacheKey fileName:NULL];
+        if (imageData) {
+            return imageData;
+        }
+    }
+
+    return nil;
+}
+
+- (BOOL)filter:(nonnull YSCImageCacheFilter *)filter mayContainCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    if ([filter mayContainDigest:cacheKey.digest]) {
+        return YES;
+    }
+    return self.config.shouldReadLegacyDiskCacheFileNames && [filter mayContainDigest:cacheKey.legacyDigest];
+}
+
+// The names the key may have on disk, most recent first
+- (nonnull NSArray<NSString *> *)fileNamesForCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    NSMutableArray<NSString *> *fileNames = [NSMutableArray arrayWithObject:cacheKey.fileName];
+    // fallback because of https://github.com/rs/YSCWebImage/pull/976 that added the extension to the disk file name
+    // checking the key with and without the extension
+    if (![cacheKey.fileNameWithoutExtension isEqualToString:cacheKey.fileName]) {
+        [fileNames addObject:cacheKey.fileNameWithoutExtension];
+    }
+    // the files written before the cache switched from MD5 to the faster digest
+    if (self.config.shouldReadLegacyDiskCacheFileNames) {
+        [fileNames addObject:cacheKey.legacyFileName];
+        if (![cacheKey.legacyFileNameWithoutExtension isEqualToString:cacheKey.legacyFileName]) {
+            [fileNames addObject:cacheKey.legacyFileNameWithoutExtension];
+        }
+    }
+    return fileNames;
+}
+
+- (nullable NSData *)diskImageDataInDirectory:(nonnull NSString *)directory
+                                     cacheKey:(nonnull YSCImageCacheKey *)cacheKey
+                                     fileName:(NSString * _Nullable * _Nullable)fileName {
+    for (NSString *candidate in [self fileNamesForCacheKey:cacheKey]) {
+        NSData *data = [self diskImageDataAtPath:[directory stringByAppendingPathComponent:candidate]];
+        if (data) {
+            if (fileName) {
+                *fileName = candidate;
+            }
+            return data;
+        }
+    }
+    return nil;
+}
+
+#pragma mark - Verification
+
+// Checked on every read: a truncated file is found without touching the pages of the mapping
+- (BOOL)isDiskDataSizeValid:(nonnull NSData *)data forEntry:(nonnull YSCImageCacheIndexEntry *)entry {
+    return data.length == entry.size;
+}
+
+// Hashes the whole file, only done for the files suspected to be corrupt
+- (BOOL)isDiskData:(nonnull NSData *)data validForEntry:(nonnull YSCImageCacheIndexEntry *)entry {
+    if (![self isDiskDataSizeValid:data forEntry:entry]) {
+        return NO;
+    }
+    return entry.checksum == 0 || YSCImageCacheChecksumMake(data) == entry.checksum;
+}
+
+// A file of the right size that doesn't decode gets its checksum checked, and is quarantined if it doesn't match
+- (void)verifyUndecodableDiskDataForKey:(nonnull NSString *)key {
+    if (self.packStorage || !self.config.shouldVerifyDiskCacheChecksums) {
+        return;
+    }
+    YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+    YSCImageCacheIndexEntry *entry = [self.diskIndex entryForFileName:cacheKey.fileName];
+    if (entry) {
+        [self quarantineIndexedFile:entry cacheKey:cacheKey];
+    }
+}
+
+- (nonnull NSString *)quarantinePath {
+    // Hidden, so the index never picks the quarantined files up. Emptied by the next cleanup.
+    return [self.diskCachePath stringByAppendingPathComponent:@".YSCImageCacheQuarantine"];
+}
+
+// Move a corrupt file out of the cache so the key misses instead of failing to decode on every query
+- (void)quarantineIndexedFile:(nonnull YSCImageCacheIndexEntry *)entry cacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    dispatch_barrier_async([self ioQueueForCacheKey:cacheKey], ^{
+        if ([self.diskIndex entryForFileName:entry.fileName] != entry) {
+            // stored again since
+            return;
+        }
+        // checked again with the writes of the key excluded, the read may have raced with the write of the file
+        NSString *sourcePath = [self.diskCachePath stringByAppendingPathComponent:entry.fileName];
+        NSData *data = [NSData dataWithContentsOfFile:sourcePath];
+        if (!data || [self isDiskData:data validForEntry:entry]) {
+            return;
+        }
+        NSString *quarantinePath = [self quarantinePath];
+        NSString *destinationPath = [quarantinePath stringByAppendingPathComponent:entry.fileName];
+        [_fileManager createDirectoryAtPath:quarantinePath withIntermediateDirectories:YES attributes:nil error:NULL];
+        [_fileManager removeItemAtPath:destinationPath error:nil];
+        if (![_fileManager moveItemAtPath:sourcePath toPath:destinationPath error:nil]) {
+            [_fileManager removeItemAtPath:sourcePath error:nil];
+        }
+        [self removeIndexEntryForFileName:entry.fileName];
+        atomic_fetch_add_explicit(&_quarantinedFileCount, 1, memory_order_relaxed);
+    });
+}
+
+// Remove a file that expired before the next cleanup, as soon as it's read
+- (void)removeExpiredIndexedFile:(nonnull YSCImageCacheIndexEntry *)entry cacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    dispatch_barrier_async([self ioQueueForCacheKey:cacheKey], ^{
+        if ([self.diskIndex entryForFileName:entry.fileName] != entry) {
+            // stored again since
+            return;
+        }
+        [self removeIndexedFile:entry];
+    });
+}
+
+// Rename a file found under an older name, so the next reads find it on the first try
+- (void)migrateFileName:(nonnull NSString *)fileName toFileNameOfCacheKey:(nonnull YSCImageCacheKey *)cacheKey {
+    dispatch_barrier_async([self ioQueueForCacheKey:cacheKey], ^{
+        NSString *sourcePath = [self.diskCachePath stringByAppendingPathComponent:fileName];
+        NSString *destinationPath = [self.diskCachePath stringByAppendingPathComponent:cacheKey.fileName];
+        YSCImageCacheIndexEntry *entry = [self.diskIndex entryForFileName:fileName];
+        if ([_fileManager fileExistsAtPath:destinationPath]) {
+            // stored again since, the old file is stale
+            [_fileManager removeItemAtPath:sourcePath error:nil];
+        } else if (![_fileManager moveItemAtPath:sourcePath toPath:destinationPath error:nil]) {
+            return;
+        } else if (entry) {
+            YSCImageCacheIndexEntry *migratedEntry = [YSCImageCacheIndexEntry new];
+            migratedEntry.fileName = cacheKey.fileName;
+            migratedEntry.key = cacheKey.key;
+            migratedEntry.size = entry.size;
+            migratedEntry.modificationTime = entry.modificationTime;
+            migratedEntry.accessTime = [[NSDate date] timeIntervalSince1970];
+            migratedEntry.expirationTime = entry.expirationTime;
+            migratedEntry.checksum = entry.checksum;
+            [self setIndexEntry:migratedEntry];
+        }
+        [self removeIndexEntryForFileName:fileName];
+    });
+}
+
+- (nullable UIImage *)diskImageForKey:(nullable NSString *)key {
+    NSData *data = [self diskImageDataBySearchingAllPathsForKey:key];
+    return [self diskImageForKey:key data:data];
+}
+
+// Decode the data already read from disk, so a lookup never has to read the same file twice
+- (nullable UIImage *)diskImageForKey:(nullable NSString *)key data:(nullable NSData *)data {
+    if (data) {
+        UIImage *image = [[YSCWebImageCodersManager sharedInstance] decodedImageWithData:data];
+        image = [self scaledImageForKey:key image:image];
+        if (self.config.shouldDecompressImages) {
+            // the coder may replace this local reference, the caller keeps the buffer that was read
+            NSData *decompressData = data;
+            image = [[YSCWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&decompressData options:@{YSCWebImageCoderScaleDownLargeImagesKey: @(NO)}];
+        }
+        return image;
+    } else {
+        return nil;
+    }
+}
+
+- (nullable UIImage *)scaledImageForKey:(nullable NSString *)key image:(nullable UIImage *)image {
+    return YSCScaledImageForKey(key, image);
+}
+
+- (nullable NSOperation *)queryCacheOperationForKey:(nullable NSString *)key done:(nullable YSCCacheQueryCompletedBlock)doneBlock {
+    if (!key) {
+        if (doneBlock) {
+            doneBlock(nil, nil, YSCImageCacheTypeNone);
+        }
+        return nil;
+    }
+
+    uint64_t startTime = mach_absolute_time();
+    YSCImageCacheMetricsRecorder *metricsRecorder = self.activeMetricsRecorder;
+    YSCImageCacheTraceRecorder *traceRecorder = self.traceRecorder;
+
+    // First check the in-memory cache...
+    UIImage *image = [self imageFromMemoryCacheForKey:key];
+    if (image) {
+        [metricsRecorder addValue:1 toCounter:YSCImageCacheMetricsCounterMemoryHit];
+        NSData *imageData = nil;
+        if (image.images) {
+            imageData = YSCImageDataForAnimatedImage(image) ?: [self imageDataFromMemoryCacheForKey:key];
+            if (!imageData) {
+                // Not known yet, e.g. the image was stored without its data and is still being encoded.
+                // Read it on the IO queue, never on the caller's thread.
+                return [self queryImageDataOperationForAnimatedImage:image cacheKey:[YSCImageCacheKey keyWithString:key] startTime:startTime done:doneBlock];
+            }
+        }
+        if (doneBlock) {
+            doneBlock(image, imageData, YSCImageCacheTypeMemory);
+        }
+        [metricsRecorder recordOperation:YSCImageCacheMetricsOperationQuery startTime:startTime];
+        [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:imageData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+        return nil;
+    }
+
+    NSOperation *operation = [NSOperation new];
+
+    // Then the encoded data tier, decoding from memory doesn't need to wait for the IO queue
+    NSData *memoryData = [self imageDataFromMemoryCacheForKey:key];
+    [metricsRecorder addValue:1 toCounter:memoryData ? YSCImageCacheMetricsCounterMemoryHit : YSCImageCacheMetricsCounterMemoryMiss];
+    if (memoryData) {
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+            if (operation.isCancelled) {
+                // do not call the completion if cancelled
+                return;
+            }
+
+            @autoreleasepool {
+                UIImage *image = [self memoryCachedImageForKey:key data:memoryData];
+
+                if (doneBlock) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        [metricsRecorder recordOperation:YSCImageCacheMetricsOperationQuery startTime:startTime];
+                        [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:memoryData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+                        doneBlock(image, memoryData, YSCImageCacheTypeMemory);
+                    });
+                } else {
+                    [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:memoryData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+                }
+            }
+        });
+        return operation;
+    }
+
+    // The digest and the file names are computed once for the whole lookup
+    YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+    dispatch_async([self ioQueueForCacheKey:cacheKey], [self measuredIOQueueBlock:^{
+        if (operation.isCancelled) {
+            // do not call the completion if cancelled
+            return;
+        }
+
+        @autoreleasepool {
+            NSData *diskData = [self diskImageDataBySearchingAllPathsForCacheKey:cacheKey];
+            [self storeImageDataToMemory:diskData forKey:key];
+            UIImage *diskImage = [self memoryCachedImageForKey:key data:diskData];
+            YSCImageCacheTraceTier tier = diskImage ? YSCImageCacheTraceTierDisk : YSCImageCacheTraceTierNone;
+
+            if (doneBlock) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [metricsRecorder recordOperation:YSCImageCacheMetricsOperationQuery startTime:startTime];
+                    [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:diskData.length tier:tier startTime:startTime];
+                    doneBlock(diskImage, diskData, YSCImageCacheTypeDisk);
+                });
+            } else {
+                [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:diskData.length tier:tier startTime:startTime];
+            }
+        }
+    }]);
+
+    return operation;
+}
+
+// Decode the data read from the disk or the data tier, and keep the image in memory
+- (nullable UIImage *)memoryCachedImageForKey:(nonnull NSString *)key data:(nullable NSData *)data {
+    UIImage *image = [self diskImageForKey:key data:data];
+    if (!image && data) {
+        [self verifyUndecodableDiskDataForKey:key];
+    }
+    YSCSetImageDataForAnimatedImage(image, data);
+    if (image && self.config.shouldCacheImagesInMemory) {
+        [self storeImageToMemory:image forKey:key expirationTime:[self diskExpirationTimeForKey:key]];
+        if (YSCImageDataForAnimatedImage(image)) {
+            // counted in the cost of the image now
+            [self.dataMemCache removeObjectForKey:key];
+        }
+    }
+    return image;
+}
+
+- (nullable NSOperation *)queryCacheOperationsForKeys:(nonnull NSArray<NSString *> *)keys done:(nullable YSCCacheBatchQueryCompletedBlock)doneBlock {
+    uint64_t startTime = mach_absolute_time();
+    YSCImageCacheTraceRecorder *traceRecorder = self.traceRecorder;
+    // First check the in-memory cache for all the keys, in a single pass
+    NSMutableArray<YSCImageCacheQueryResult *> *memoryResults = [NSMutableArray arrayWithCapacity:keys.count];
+    // The animated images found in memory without their data only need the data read
+    NSMutableDictionary<NSString *, UIImage *> *animatedImages = [NSMutableDictionary dictionary];
+    NSUInteger queueCount = self.ioQueues.count;
+    NSMutableArray<NSMutableArray<YSCImageCacheKey *> *> *keysByQueue = [NSMutableArray arrayWithCapacity:queueCount];
+    for (NSUInteger i = 0; i < queueCount; i++) {
+        [keysByQueue addObject:[NSMutableArray array]];
+    }
+    NSMutableSet<NSString *> *seenKeys = [NSMutableSet setWithCapacity:keys.count];
+    for (NSString *key in keys) {
+        if ([seenKeys containsObject:key]) {
+            continue;
+        }
+        [seenKeys addObject:key];
+
+        UIImage *image = [self imageFromMemoryCacheForKey:key];
+        if (image) {
+            NSData *imageData = nil;
+            if (image.images) {
+                imageData = YSCImageDataForAnimatedImage(image) ?: [self imageDataFromMemoryCacheForKey:key];
+                if (!imageData) {
+                    animatedImages[key] = image;
+                    YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+                    [keysByQueue[[self ioQueueIndexForCacheKey:cacheKey]] addObject:cacheKey];
+                    continue;
+                }
+            }
+            [memoryResults addObject:[YSCImageCacheQueryResult resultWithKey:key image:image data:imageData cacheType:YSCImageCacheTypeMemory]];
+            [self.activeMetricsRecorder addValue:1 toCounter:YSCImageCacheMetricsCounterMemoryHit];
+            [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:imageData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+        } else {
+            YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+            [keysByQueue[[self ioQueueIndexForCacheKey:cacheKey]] addObject:cacheKey];
+        }
+    }
+
+    BOOL finished = memoryResults.count == seenKeys.count;
+    if (doneBlock && (memoryResults.count > 0 || finished)) {
+        doneBlock(memoryResults, finished);
+    }
+    if (finished) {
+        return nil;
+    }
+
+    NSOperation *operation = [NSOperation new];
+    dispatch_group_t group = dispatch_group_create();
+    for (NSUInteger i = 0; i < queueCount; i++) {
+        NSArray<YSCImageCacheKey *> *queueKeys = keysByQueue[i];
+        if (queueKeys.count == 0) {
+            continue;
+        }
+        dispatch_group_async(group, self.ioQueues[i], [self measuredIOQueueBlock:^{
+            [self readDiskResultsForCacheKeys:queueKeys animatedImages:animatedImages startTime:startTime operation:operation done:doneBlock];
+        }]);
+    }
+    // Enqueued on the main queue after all the deliveries of the blocks
+    dispatch_group_notify(group, dispatch_get_main_queue(), ^{
+        if (doneBlock && !operation.isCancelled) {
+            doneBlock(@[], YES);
+        }
+    });
+
+    return operation;
+}
+
+// Must be called from the IO queue of the keys
+- (void)readDiskResultsForCacheKeys:(nonnull NSArray<YSCImageCacheKey *> *)queueKeys
+                     animatedImages:(nonnull NSDictionary<NSString *, UIImage *> *)animatedImages
+                          startTime:(uint64_t)startTime
+                          operation:(nonnull NSOperation *)operation
+                               done:(nullable YSCCacheBatchQueryCompletedBlock)doneBlock {
+    NSMutableArray<NSString *> *keys = [NSMutableArray arrayWithCapacity:queueKeys.count];
+    NSMutableDictionary<NSString *, YSCImageCacheKey *> *cacheKeys = [NSMutableDictionary dictionaryWithCapacity:queueKeys.count];
+    for (YSCImageCacheKey *cacheKey in queueKeys) {
+        [keys addObject:cacheKey.key];
+        cacheKeys[cacheKey.key] = cacheKey;
+    }
+    // The pack segments are read in the order of their data. The files of the file per key layout are placed by the
+    // file system, their names say nothing about it, so they're read in the order they were asked for.
+    YSCImageCachePackStorage *packStorage = self.packStorage;
+    NSArray<NSString *> *sortedKeys = packStorage ? [packStorage keysSortedByLocation:keys] : keys;
+
+    YSCImageCacheTraceRecorder *traceRecorder = self.traceRecorder;
+    NSMutableArray<YSCImageCacheQueryResult *> *results = [NSMutableArray arrayWithCapacity:kYSCBatchQueryDeliveryCount];
+    for (NSString *key in sortedKeys) {
+        if (operation.isCancelled) {
+            // do not call the completion if cancelled
+            return;
+        }
+
+        @autoreleasepool {
+            YSCImageCacheType cacheType = YSCImageCacheTypeMemory;
+            NSData *data = [self imageDataFromMemoryCacheForKey:key];
+            BOOL memoryHit = data || animatedImages[key];
+            [self.activeMetricsRecorder addValue:1 toCounter:memoryHit ? YSCImageCacheMetricsCounterMemoryHit : YSCImageCacheMetricsCounterMemoryMiss];
+            if (!data) {
+                data = [self diskImageDataBySearchingAllPathsForCacheKey:cacheKeys[key]];
+                [self storeImageDataToMemory:data forKey:key];
+                cacheType = data ? YSCImageCacheTypeDisk : YSCImageCacheTypeNone;
+            }
+
+            UIImage *image = animatedImages[key];
+            if (image) {
+                cacheType = YSCImageCacheTypeMemory;
+            } else {
+                image = [self memoryCachedImageForKey:key data:data];
+                if (!image) {
+                    cacheType = YSCImageCacheTypeNone;
+                }
+            }
+            [results addObject:[YSCImageCacheQueryResult resultWithKey:key image:image data:data cacheType:cacheType]];
+            // the batch latency, up to the read of this key
+            [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:data.length tier:(YSCImageCacheTraceTier)cacheType startTime:startTime];
+        }
+
+        if (results.count == kYSCBatchQueryDeliveryCount) {
+            [self deliverBatchQueryResults:results operation:operation done:doneBlock];
+            results = [NSMutableArray arrayWithCapacity:kYSCBatchQueryDeliveryCount];
+        }
+    }
+    if (results.count > 0) {
+        [self deliverBatchQueryResults:results operation:operation done:doneBlock];
+    }
+}
+
+- (void)deliverBatchQueryResults:(nonnull NSArray<YSCImageCacheQueryResult *> *)results
+                       operation:(nonnull NSOperation *)operation
+                            done:(nullable YSCCacheBatchQueryCompletedBlock)doneBlock {
+    if (!doneBlock) {
+        return;
+    }
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!operation.isCancelled) {
+            doneBlock(results, NO);
+        }
+    });
+}
+
+- (nonnull NSOperation *)queryImageDataOperationForAnimatedImage:(nonnull UIImage *)image
+                                                        cacheKey:(nonnull YSCImageCacheKey *)cacheKey
+                                                       startTime:(uint64_t)startTime
+                                                            done:(nullable YSCCacheQueryCompletedBlock)doneBlock {
+    NSString *key = cacheKey.key;
+    NSOperation *operation = [NSOperation new];
+    YSCImageCacheTraceRecorder *traceRecorder = self.traceRecorder;
+    dispatch_async([self ioQueueForCacheKey:cacheKey], [self measuredIOQueueBlock:^{
+        if (operation.isCancelled) {
+            // do not call the completion if cancelled
+            return;
+        }
+
+        @autoreleasepool {
+            NSData *diskData = [self diskImageDataBySearchingAllPathsForCacheKey:cacheKey];
+            [self storeImageDataToMemory:diskData forKey:key];
+
+            if (doneBlock) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    [self.activeMetricsRecorder recordOperation:YSCImageCacheMetricsOperationQuery startTime:startTime];
+                    [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:diskData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+                    doneBlock(image, diskData, YSCImageCacheTypeMemory);
+                });
+            } else {
+                [traceRecorder recordOperation:YSCImageCacheTraceOperationQuery key:key size:diskData.length tier:YSCImageCacheTraceTierMemory startTime:startTime];
+            }
+        }
+    }]);
+
+    return operation;
+}
+
+#pragma mark - Memory counters
+
+- (YSCImageCacheMemoryCounters)memoryCounters {
+    YSCImageCacheMemoryCounters counters;
+    counters.hitCount = self.memCache.hitCount;
+    counters.missCount = self.memCache.missCount;
+    counters.evictionCount = self.memCache.evictionCount;
+    counters.residentBytes = self.memCache.totalCost;
+    counters.residentCount = self.memCache.totalCount;
+    counters.dataHitCount = atomic_load_explicit(&_dataHitCount, memory_order_relaxed);
+    counters.dataResidentBytes = self.dataMemCache.totalCost;
+    return counters;
+}
+
+- (void)resetMemoryCounters {
+    [self.memCache resetStatistics];
+    [self.dataMemCache resetStatistics];
+    atomic_store_explicit(&_dataHitCount, 0, memory_order_relaxed);
+}
+
+#pragma mark - Disk read counters
+
+- (YSCImageCacheDiskReadCounters)diskReadCounters {
+    YSCImageCacheDiskReadCounters counters;
+    counters.diskQueryCount = atomic_load_explicit(&_diskQueryCount, memory_order_relaxed);
+    counters.fileReadAttempts = atomic_load_explicit(&_fileReadAttempts, memory_order_relaxed);
+    counters.bytesRead = atomic_load_explicit(&_bytesRead, memory_order_relaxed);
+    counters.bytesMapped = atomic_load_explicit(&_bytesMapped, memory_order_relaxed);
+    counters.quarantinedFileCount = atomic_load_explicit(&_quarantinedFileCount, memory_order_relaxed);
+    return counters;
+}
+
+- (void)resetDiskReadCounters {
+    atomic_store_explicit(&_diskQueryCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_fileReadAttempts, 0, memory_order_relaxed);
+    atomic_store_explicit(&_bytesRead, 0, memory_order_relaxed);
+    atomic_store_explicit(&_bytesMapped, 0, memory_order_relaxed);
+    atomic_store_explicit(&_quarantinedFileCount, 0, memory_order_relaxed);
+}
+
+#pragma mark - Metrics
+
+// nil unless the metrics are enabled, so recording costs a message to nil
+- (nullable YSCImageCacheMetricsRecorder *)activeMetricsRecorder {
+    return self.config.shouldCollectMetrics ? self.metricsRecorder : nil;
+}
+
+- (nonnull dispatch_block_t)measuredIOQueueBlock:(nonnull dispatch_block_t)block {
+    YSCImageCacheMetricsRecorder *metricsRecorder = self.activeMetricsRecorder;
+    return metricsRecorder ? [metricsRecorder measuredIOQueueBlock:block] : block;
+}
+
+- (YSCImageCacheMetrics)metricsByResetting:(BOOL)reset {
+    YSCImageCacheMetrics metrics = [self.metricsRecorder snapshotByResetting:reset];
+    // The memory cache counts its evictions, the metrics only remember where they started
+    uint64_t evictionCount = self.memCache.evictionCount;
+    uint64_t evictionBase = reset ? atomic_exchange_explicit(&_metricsMemoryEvictionBase, evictionCount, memory_order_relaxed)
+                                  : atomic_load_explicit(&_metricsMemoryEvictionBase, memory_order_relaxed);
+    // the memory counters were reset since
+    metrics.memoryEvictionCount = evictionCount >= evictionBase ? evictionCount - evictionBase : evictionCount;
+    return metrics;
+}
+
+#pragma mark - Trace
+
+- (BOOL)startRecordingTraceAtPath:(nonnull NSString *)path {
+    YSCImageCacheTraceRecorder *traceRecorder = [[YSCImageCacheTraceRecorder alloc] initWithPath:path];
+    if (!traceRecorder) {
+        return NO;
+    }
+    YSCImageCacheTraceRecorder *previousRecorder;
+    @synchronized (self) {
+        previousRecorder = self.traceRecorder;
+        self.traceRecorder = traceRecorder;
+    }
+    [previousRecorder close];
+    return YES;
+}
+
+- (void)stopRecordingTrace {
+    YSCImageCacheTraceRecorder *traceRecorder;
+    @synchronized (self) {
+        traceRecorder = self.traceRecorder;
+        self.traceRecorder = nil;
+    }
+    [traceRecorder close];
+}
+
+#pragma mark - Remove Ops
+
+- (void)removeImageForKey:(nullable NSString *)key withCompletion:(nullable YSCWebImageNoParamsBlock)completion {
+    [self removeImageForKey:key fromDisk:YES withCompletion:completion];
+}
+
+- (void)removeImageForKey:(nullable NSString *)key fromDisk:(BOOL)fromDisk withCompletion:(nullable YSCWebImageNoParamsBlock)completion {
+    if (key == nil) {
+        return;
+    }
+
+    if (self.config.shouldCacheImagesInMemory) {
+        [self.memCache removeObjectForKey:key];
+        [self.dataMemCache removeObjectForKey:key];
+    }
+
+    if (fromDisk) {
+        [self discardPendingWritesForKey:key];
+        YSCImageCacheKey *cacheKey = [YSCImageCacheKey keyWithString:key];
+        dispatch_barrier_async([self ioQueueForCacheKey:cacheKey], ^{
+            YSCImageCachePackStorage *packStorage = self.packStorage;
+            if (packStorage) {
+                [packStorage removeDataForKey:key];
+            } else {
+                for (NSString *fileName in [self fileNamesForCacheKey:cacheKey]) {
+                    [_fileManager removeItemAtPath:[self.diskCachePath stringByAppendingPathComponent:fileName] error:nil];
+                    [self removeIndexEntryForFileName:fileName];
+                }
+            }
+            
+            if (completion) {
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    completion();
+                });
+            }
+        });
+    } else if (completion){
+        completion();
+    }
+    
+}
 
 # pragma mark - Mem Cache settings
 
@@ -459,26 +1672,72 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
     self.memCache.countLimit = maxCountLimit;
 }
 
+- (void)setMaxMemoryDataCost:(NSUInteger)maxMemoryDataCost {
+    self.dataMemCache.totalCostLimit = maxMemoryDataCost;
+}
+
+- (NSUInteger)maxMemoryDataCost {
+    return self.dataMemCache.totalCostLimit;
+}
+
+- (void)setMaxMemoryDataCountLimit:(NSUInteger)maxMemoryDataCountLimit {
+    self.dataMemCache.countLimit = maxMemoryDataCountLimit;
+}
+
+- (NSUInteger)maxMemoryDataCountLimit {
+    return self.dataMemCache.countLimit;
+}
+
 #pragma mark - Cache clean Ops
 
 - (void)clearMemory {
     [self.memCache removeAllObjects];
+    [self.dataMemCache removeAllObjects];
+}
+
+- (void)trimMemoryToRatio:(double)ratio {
+    [self.memCache trimToRatio:ratio];
+    [self.dataMemCache trimToRatio:ratio];
+}
+
+#if YSC_UIKIT
+- (void)didReceiveMemoryWarning {
+    [self trimMemoryToRatio:self.config.memoryCacheRatioKeptOnMemoryWarning];
+}
+#endif
+
+- (void)didReceiveMemoryPressure:(unsigned long)status {
+    if (status & DISPATCH_MEMORYPRESSURE_CRITICAL) {
+        [self.memCache removeAllObjects];
+        [self.dataMemCache removeAllObjects];
+    } else if (status & DISPATCH_MEMORYPRESSURE_WARN) {
+        [self trimMemoryToRatio:self.config.memoryCacheRatioKeptOnMemoryWarning];
+    }
 }
 
 - (void)clearDiskOnCompletion:(nullable YSCWebImageNoParamsBlock)completion {
-    dispatch_async(self.ioQueue, ^{
+    [self discardPendingWritesForKey:nil];
+    [self dispatchBarrierOnAllIOQueues:^{
+        @synchronized (self.pendingWrites) {
+            _diskCacheDirectoryReady = NO;
+        }
+        [self.packStorage removeAllData];
         [_fileManager removeItemAtPath:self.diskCachePath error:nil];
         [_fileManager createDirectoryAtPath:self.diskCachePath
                 withIntermediateDirectories:YES
                                  attributes:nil
                                       error:NULL];
+        @synchronized (self.diskFilter) {
+            [self.diskIndex removeAllEntries];
+            [self.diskFilter removeAllDigests];
+        }
 
         if (completion) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completion();
             });
         }
-    });
+    }];
 }
 
 - (void)deleteOldFiles {
@@ -486,76 +1745,233 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
 }
 
 - (void)deleteOldFilesWithCompletionBlock:(nullable YSCWebImageNoParamsBlock)completionBlock {
-    dispatch_async(self.ioQueue, ^{
-        NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
-        NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLTotalFileAllocatedSizeKey];
-
-        // This enumerator prefetches useful properties for our cache files.
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtURL:diskCacheURL
-                                                   includingPropertiesForKeys:resourceKeys
-                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                 errorHandler:NULL];
-
-        NSDate *expirationDate = [NSDate dateWithTimeIntervalSinceNow:-self.config.maxCacheAge];
-        NSMutableDictionary<NSURL *, NSDictionary<NSString *, id> *> *cacheFiles = [NSMutableDictionary dictionary];
-        NSUInteger currentCacheSize = 0;
-
-        // Enumerate all of the files in the cache directory.  This loop has two purposes:
-        //
-        //  1. Removing files that are older than the expiration date.
-        //  2. Storing file attributes for the size-based cleanup pass.
-        NSMutableArray<NSURL *> *urlsToDelete = [[NSMutableArray alloc] init];
-        for (NSURL *fileURL in fileEnumerator) {
-            NSError *error;
-            NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:&error];
-
-            // Skip directories and errors.
-            if (error || !resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
-                continue;
+    // Called when the app goes to the background or terminates, don't leave the stores in memory
+    [self flushPendingWrites];
+    [self saveHotSet];
+    // Evictions are picked on the background maintenance queue, and each file is removed by a barrier of its shard
+    dispatch_async(self.maintenanceQueue, ^{
+        uint64_t startTime = mach_absolute_time();
+        NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+        NSTimeInterval expirationTime = now - self.config.maxCacheAge;
+
+        [self.packStorage removeExpiredDataWithExpirationDate:[NSDate dateWithTimeIntervalSince1970:expirationTime]];
+        [_fileManager removeItemAtPath:[self quarantinePath] error:nil];
+
+        // Remove the files that are older than the expiration date. This works from the index, the cache directory
+        // is never enumerated. It also cleans up the files left over from the other layout.
+        dispatch_group_t group = dispatch_group_create();
+        for (YSCImageCacheIndexEntry *entry in [self.diskIndex allEntries]) {
+            BOOL expired = entry.expirationTime > 0 ? entry.expirationTime <= now : entry.modificationTime <= expirationTime;
+            if (expired) {
+                [self evictIndexedFile:entry group:group];
             }
+        }
 
-            // Remove files that are older than the expiration date;
-            NSDate *modificationDate = resourceValues[NSURLContentModificationDateKey];
-            if ([[modificationDate laterDate:expirationDate] isEqualToDate:expirationDate]) {
-                [urlsToDelete addObject:fileURL];
-                continue;
-            }
+        // Then evict the least recently used images down to the low watermark, a few at a time, once the index
+        // doesn't count the expired files anymore.
+        dispatch_group_notify(group, self.maintenanceQueue, ^{
+            [self trimDiskCacheStepWithCompletionBlock:^{
+                [self.activeMetricsRecorder recordOperation:YSCImageCacheMetricsOperationCleanup startTime:startTime];
+                if (completionBlock) {
+                    dispatch_async(dispatch_get_main_queue(), ^{
+                        completionBlock();
+                    });
+                }
+            }];
+        });
+    });
+}
+
+#pragma mark - Disk cache trimming
 
-            // Store a reference to this file and account for its total size.
-            NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
-            currentCacheSize += totalAllocatedSize.unsignedIntegerValue;
-            cacheFiles[fileURL] = resourceValues;
+- (BOOL)isDiskCacheAboveWatermark:(double)watermark {
+    NSUInteger size = self.packStorage ? self.packStorage.totalSize : self.diskIndex.totalSize;
+    NSUInteger count = self.packStorage ? self.packStorage.totalCount : self.diskIndex.totalCount;
+    return (self.config.maxCacheSize > 0 && size > self.config.maxCacheSize * watermark)
+        || (self.config.maxCacheCount > 0 && count > self.config.maxCacheCount * watermark);
+}
+
+- (void)trimDiskCacheIfNeeded {
+    if (![self isDiskCacheAboveWatermark:self.config.diskCacheHighWatermark]) {
+        return;
+    }
+    if (atomic_exchange(&_diskCacheTrimming, true)) {
+        return;
+    }
+    dispatch_async(self.maintenanceQueue, ^{
+        [self trimDiskCacheStepWithCompletionBlock:^{
+            atomic_store(&_diskCacheTrimming, false);
+        }];
+    });
+}
+
+// Must be called from the maintenance queue, the completion block is called on the maintenance queue as well
+- (void)trimDiskCacheStepWithCompletionBlock:(nullable YSCWebImageNoParamsBlock)completionBlock {
+    const double lowWatermark = self.config.diskCacheLowWatermark;
+    const NSUInteger targetSize = self.config.maxCacheSize > 0 ? (NSUInteger)(self.config.maxCacheSize * lowWatermark) : NSUIntegerMax;
+    const NSUInteger targetCount = self.config.maxCacheCount > 0 ? (NSUInteger)(self.config.maxCacheCount * lowWatermark) : NSUIntegerMax;
+
+    BOOL needsMoreSteps = NO;
+    dispatch_group_t group = dispatch_group_create();
+    YSCImageCachePackStorage *packStorage = self.packStorage;
+    if (packStorage) {
+        needsMoreSteps = [packStorage trimToSize:targetSize count:targetCount limit:kYSCDiskCacheTrimStepCount];
+    } else {
+        BOOL sizeWeighted = self.config.diskCacheEvictionPolicy == YSCImageCacheEvictionPolicySizeAware;
+        NSArray<YSCImageCacheIndexEntry *> *entries = [self.diskIndex leastRecentlyUsedEntriesExceedingSize:targetSize
+                                                                                                       count:targetCount
+                                                                                                       limit:kYSCDiskCacheTrimStepCount
+                                                                                                sizeWeighted:sizeWeighted];
+        for (YSCImageCacheIndexEntry *entry in entries) {
+            [self evictIndexedFile:entry group:group];
         }
-        
-        for (NSURL *fileURL in urlsToDelete) {
-            [_fileManager removeItemAtURL:fileURL error:nil];
-        }
-
-        // If our remaining disk cache exceeds a configured maximum size, perform a second
-        // size-based cleanup pass.  We delete the oldest files first.
-        if (self.config.maxCacheSize > 0 && currentCacheSize > self.config.maxCacheSize) {
-            // Target half of our maximum cache size for this cleanup pass.
-            const NSUInteger desiredCacheSize = self.config.maxCacheSize / 2;
-
-            // Sort the remaining cache files by their last modification time (oldest first).
-            NSArray<NSURL *> *sortedFiles = [cacheFiles keysSortedByValueWithOptions:NSSortConcurrent
-                                                                     usingComparator:^NSComparisonResult(id obj1, id obj2) {
-                                                                         return [obj1[NSURLContentModificationDateKey] compare:obj2[NSURLContentModificationDateKey]];
-                                                                     }];
-
-            // Delete files until we fall below our desired cache size.
-            for (NSURL *fileURL in sortedFiles) {
-                if ([_fileManager removeItemAtURL:fileURL error:nil]) {
-                    NSDictionary<NSString *, id> *resourceValues = cacheFiles[fileURL];
-                    NSNumber *totalAllocatedSize = resourceValues[NSURLTotalFileAllocatedSizeKey];
-                    currentCacheSize -= totalAllocatedSize.unsignedIntegerValue;
-
-                    if (currentCacheSize < desiredCacheSize) {
-                        break;
-                    }
-                }
-            }
+        needsMoreSteps = entries.count == kYSCDiskCacheTrimStepCount;
+    }
+
+    // The next step is picked once the removals of this one are done, the index counts them then
+    dispatch_group_notify(group, self.maintenanceQueue, ^{
+        if (needsMoreSteps) {
+            [self trimDiskCacheStepWithCompletionBlock:completionBlock];
+        } else if (completionBlock) {
+            completionBlock();
+        }
+    });
+}
+
+// Remove a file picked by a cleanup. It runs as a barrier of the file's shard, so it can't interleave with a store of
+// the key, and it's skipped if the file was stored again or read since it was picked.
+- (void)evictIndexedFile:(nonnull YSCImageCacheIndexEntry *)entry group:(nonnull dispatch_group_t)group {
+    dispatch_group_enter(group);
+    dispatch_barrier_async([self ioQueueForIndexEntry:entry], ^{
+        if ([self.diskIndex entryForFileName:entry.fileName] == entry) {
+            [self removeIndexedFile:entry];
+        }
+        dispatch_group_leave(group);
+    });
+}
+
+// Must be called from a barrier of the IO queue of the file
+- (void)removeIndexedFile:(nonnull YSCImageCacheIndexEntry *)entry {
+    // A file that is already gone leaves the index as well
+    [_fileManager removeItemAtPath:[self.diskCachePath stringByAppendingPathComponent:entry.fileName] error:nil];
+    [self removeIndexEntryForFileName:entry.fileName];
+    [self.activeMetricsRecorder addValue:1 toCounter:YSCImageCacheMetricsCounterDiskEviction];
+}
+
+#pragma mark - Disk filter
+
+// The filter holds the digests of the indexed file names, keep both in sync. The index and the filter are updated
+// together under the filter lock, so a rebuild never snapshots the index between the two updates.
+- (void)setIndexEntry:(nonnull YSCImageCacheIndexEntry *)entry {
+    YSCImageCacheKeyDigest digest;
+    BOOL added = NO;
+    @synchronized (self.diskFilter) {
+        if ([self.diskIndex setEntry:entry] && [YSCImageCacheFilter getDigest:&digest fromFileName:entry.fileName]) {
+            [self.diskFilter addDigest:digest];
+            added = YES;
+        }
+    }
+    if (added) {
+        [self rebuildDiskFilterIfNeeded];
+    }
+}
+
+- (void)removeIndexEntryForFileName:(nonnull NSString *)fileName {
+    YSCImageCacheKeyDigest digest;
+    @synchronized (self.diskFilter) {
+        if ([self.diskIndex removeEntryForFileName:fileName] && [YSCImageCacheFilter getDigest:&digest fromFileName:fileName]) {
+            [self.diskFilter removeDigest:digest];
+        }
+    }
+}
+
+// The filter gets less selective as it fills up, resize it once it holds more digests than it was built for
+- (void)rebuildDiskFilterIfNeeded {
+    if (self.diskFilter.count <= self.diskFilter.capacity || atomic_exchange(&_diskFilterRebuilding, true)) {
+        return;
+    }
+    dispatch_async(self.maintenanceQueue, ^{
+        [self rebuildDiskFilter];
+    });
+}
+
+// Must be called from the maintenance queue
+- (void)rebuildDiskFilter {
+    // Load the index first, so the updates aren't held back while the journal is read
+    [self.diskIndex totalCount];
+    NSArray<YSCImageCacheIndexEntry *> *entries = nil;
+    @synchronized (self.diskFilter) {
+        [self.diskFilter beginBuilding];
+        entries = [self.diskIndex allEntries];
+    }
+    NSMutableArray<NSString *> *fileNames = [NSMutableArray arrayWithCapacity:entries.count];
+    for (YSCImageCacheIndexEntry *entry in entries) {
+        [fileNames addObject:entry.fileName];
+    }
+    [self.diskFilter finishBuildingWithDigests:[YSCImageCache digestsOfFileNames:fileNames]];
+    atomic_store(&_diskFilterRebuilding, false);
+}
+
++ (nonnull NSData *)digestsOfFileNames:(nullable NSArray<NSString *> *)fileNames {
+    NSMutableData *digests = [NSMutableData dataWithCapacity:fileNames.count * sizeof(YSCImageCacheKeyDigest)];
+    for (NSString *fileName in fileNames) {
+        YSCImageCacheKeyDigest digest;
+        if ([YSCImageCacheFilter getDigest:&digest fromFileName:fileName]) {
+            [digests appendBytes:&digest length:sizeof(digest)];
         }
+    }
+    return digests;
+}
+
+#pragma mark - Hot set
+
+- (nonnull NSString *)hotSetPath {
+    // A hidden file in the cache directory, so clearing the directory also clears it
+    return [self.diskCachePath stringByAppendingPathComponent:@".YSCImageCacheHotSet"];
+}
+
+- (void)saveHotSet {
+    NSUInteger costLimit = self.config.memoryCacheHotSetCost;
+    if (costLimit == 0) {
+        return;
+    }
+    // Taken now, the memory cache may be trimmed as soon as the app is in the background
+    NSMutableData *hotSet = [NSMutableData dataWithLength:sizeof(YSCHotSetHeader)];
+    __block uint32_t count = 0;
+    __block NSUInteger totalCost = 0;
+    [self.memCache enumerateMostRecentlyUsedKeysWithLimit:kYSCHotSetMaxCount usingBlock:^(id _Nonnull key, NSUInteger cost) {
+        if (![key isKindOfClass:[NSString class]] || totalCost + cost > costLimit) {
+            return;
+        }
+        const char *str = [key UTF8String];
+        if (!str) {
+            return;
+        }
+        YSCHotSetRecord record;
+        record.keyLength = (uint32_t)strlen(str);
+        record.cost = (uint32_t)MIN(cost, UINT32_MAX);
+        [hotSet appendBytes:&record length:sizeof(record)];
+        [hotSet appendBytes:str length:record.keyLength];
+        totalCost += cost;
+        count++;
+    }];
+    YSCHotSetHeader header = {kYSCHotSetMagic, count};
+    [hotSet replaceBytesInRange:NSMakeRange(0, sizeof(header)) withBytes:&header];
+
+    dispatch_async(self.maintenanceQueue, ^{
+        if (![_fileManager fileExistsAtPath:self.diskCachePath]) {
+            return;
+        }
+        [hotSet writeToFile:[self hotSetPath] options:NSDataWritingAtomic error:nil];
+    });
+}
+
+- (void)preloadHotSetWithCompletionBlock:(nullable YSCWebImageNoParamsBlock)completionBlock {
+    // Read on the caller's thread, where the config is set
+    NSUInteger costLimit = self.config.shouldCacheImagesInMemory ? self.config.memoryCacheHotSetCost : 0;
+    // Queued behind the build of the disk filter
+    dispatch_async(self.maintenanceQueue, ^{
+        [self preloadHotSetWithCostLimit:costLimit];
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
                 completionBlock();
@@ -564,6 +1980,53 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
     });
 }
 
+// Must be called from the maintenance queue, once the disk filter is built
+- (void)preloadHotSetWithCostLimit:(NSUInteger)costLimit {
+    if (costLimit == 0) {
+        return;
+    }
+    NSData *hotSet = [NSData dataWithContentsOfFile:[self hotSetPath]];
+    if (hotSet.length < sizeof(YSCHotSetHeader)) {
+        return;
+    }
+    const uint8_t *bytes = hotSet.bytes;
+    NSUInteger length = hotSet.length;
+    YSCHotSetHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    if (header.magic != kYSCHotSetMagic) {
+        return;
+    }
+
+    // The keys are read most recently used first, a truncated file only loses its last records.
+    // The budget counts the costs recorded with the keys, so nothing is decoded past it.
+    NSUInteger offset = sizeof(header);
+    NSUInteger totalCost = 0;
+    for (uint32_t i = 0; i < header.count && offset + sizeof(YSCHotSetRecord) <= length; i++) {
+        YSCHotSetRecord record;
+        memcpy(&record, bytes + offset, sizeof(record));
+        offset += sizeof(record);
+        if (offset + record.keyLength > length) {
+            break;
+        }
+        NSString *key = [[NSString alloc] initWithBytes:bytes + offset length:record.keyLength encoding:NSUTF8StringEncoding];
+        offset += record.keyLength;
+        if (totalCost + record.cost > costLimit) {
+            break;
+        }
+        // The images stored or queried since the cache was created are more recent
+        if (!key || [self.memCache containsObjectForKey:key]) {
+            continue;
+        }
+        @autoreleasepool {
+            NSData *data = [self diskImageDataBySearchingAllPathsForCacheKey:[YSCImageCacheKey keyWithString:key]];
+            UIImage *image = [self memoryCachedImageForKey:key data:data];
+            if (image) {
+                totalCost += record.cost;
+            }
+        }
+    }
+}
+
 #if YSC_UIKIT
 - (void)backgroundDeleteOldFiles {
     Class UIApplicationClass = NSClassFromString(@"UIApplication");
@@ -589,45 +2052,17 @@ FOUNDATION_STATIC_INLINE NSUInteger YSCCacheCostForImage(UIImage *image) {
 #pragma mark - Cache Info
 
 - (NSUInteger)getSize {
-    __block NSUInteger size = 0;
-    dispatch_sync(self.ioQueue, ^{
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
-        for (NSString *fileName in fileEnumerator) {
-            NSString *filePath = [self.diskCachePath stringByAppendingPathComponent:fileName];
-            NSDictionary<NSString *, id> *attrs = [[NSFileManager defaultManager] attributesOfItemAtPath:filePath error:nil];
-            size += [attrs fileSize];
-        }
-    });
-    return size;
+    return self.diskIndex.totalSize + self.packStorage.totalSize;
 }
 
 - (NSUInteger)getDiskCount {
-    __block NSUInteger count = 0;
-    dispatch_sync(self.ioQueue, ^{
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtPath:self.diskCachePath];
-        count = fileEnumerator.allObjects.count;
-    });
-    return count;
+    return self.diskIndex.totalCount + self.packStorage.totalCount;
 }
 
 - (void)calculateSizeWithCompletionBlock:(nullable YSCWebImageCalculateSizeBlock)completionBlock {
-    NSURL *diskCacheURL = [NSURL fileURLWithPath:self.diskCachePath isDirectory:YES];
-
-    dispatch_async(self.ioQueue, ^{
-        NSUInteger fileCount = 0;
-        NSUInteger totalSize = 0;
-
-        NSDirectoryEnumerator *fileEnumerator = [_fileManager enumeratorAtURL:diskCacheURL
-                                                   includingPropertiesForKeys:@[NSFileSize]
-                                                                      options:NSDirectoryEnumerationSkipsHiddenFiles
-                                                                 errorHandler:NULL];
-
-        for (NSURL *fileURL in fileEnumerator) {
-            NSNumber *fileSize;
-            [fileURL getResourceValue:&fileSize forKey:NSURLFileSizeKey error:NULL];
-            totalSize += fileSize.unsignedIntegerValue;
-            fileCount += 1;
-        }
+    dispatch_async(self.maintenanceQueue, ^{
+        NSUInteger fileCount = self.diskIndex.totalCount + self.packStorage.totalCount;
+        NSUInteger totalSize = self.diskIndex.totalSize + self.packStorage.totalSize;
 
         if (completionBlock) {
             dispatch_async(dispatch_get_main_queue(), ^{
@@ -8,6 +8,32 @@
 
 #import <Foundation/Foundation.h>
 #import "YSCWebImageCompat.h"
+#import "NSData+YSCImageContentType.h"
+
+typedef NS_ENUM(NSInteger, YSCImageCacheDiskLayout) {
+    /**
+     * Each image is written to its own file, named after the digest of its key.
+     */
+    YSCImageCacheDiskLayoutFilePerKey,
+    /**
+     * Images are appended to large segment files indexed in memory. This avoids the per file overhead
+     * when storing a lot of small images.
+     */
+    YSCImageCacheDiskLayoutPackFile
+};
+
+typedef NS_ENUM(NSInteger, YSCImageCacheEvictionPolicy) {
+    /**
+     * Evict the least recently used images first.
+     */
+    YSCImageCacheEvictionPolicyLeastRecentlyUsed,
+    /**
+     * Keep many small images rather than a few large ones. The memory cache evicts by Greedy Dual Size Frequency
+     * and doesn't admit an image costing more than half of its limit. The disk cache evicts the largest of
+     * the least recently used images first, ordered by size times time since the last read.
+     */
+    YSCImageCacheEvictionPolicySizeAware
+};
 
 @interface YSCImageCacheConfig : NSObject
 
@@ -27,20 +53,147 @@
  */
 @property (assign, nonatomic) BOOL shouldCacheImagesInMemory;
 
+/**
+ * keep the encoded data of the recently used images in memory, next to the decoded images [defaults to YES].
+ * Only used when `shouldCacheImagesInMemory` is YES.
+ */
+@property (assign, nonatomic) BOOL shouldCacheImageDataInMemory;
+
+/**
+ * The fraction of the memory cache kept when the app receives a memory warning, the least recently used images
+ * are evicted first [defaults to 0, the memory cache is cleared]
+ */
+@property (assign, nonatomic) double memoryCacheRatioKeptOnMemoryWarning;
+
+/**
+ * The cost of the most recently used images recorded when the app goes to the background, which
+ * `-[YSCImageCache preloadHotSetWithCompletionBlock:]` reads and decodes into the memory cache at background priority
+ * [defaults to 0, disabled]
+ */
+@property (assign, nonatomic) NSUInteger memoryCacheHotSetCost;
+
+/**
+ * Also look for the disk cache files under their legacy names, named after the MD5 of the key.
+ * The files found are renamed after the current digest [defaults to YES]
+ */
+@property (assign, nonatomic) BOOL shouldReadLegacyDiskCacheFileNames;
+
+/**
+ * Check the disk cache files against the size recorded when they were written, before decoding them, and against the
+ * checksum recorded as well when they fail to decode. The files that don't match are moved out of the cache and the
+ * query misses [defaults to YES]
+ */
+@property (assign, nonatomic) BOOL shouldVerifyDiskCacheChecksums;
+
 /**
  * The reading options while reading cache from disk.
  * Defaults to 0. You can set this to mapped file to improve performance.
  */
 @property (assign, nonatomic) NSDataReadingOptions diskCacheReadingOptions;
 
+/**
+ * The size from which the disk cache files are memory mapped, and the mapping handed to the coders without a copy.
+ * Smaller files are read into a single heap buffer, mapping them costs more than copying them.
+ * Defaults to 0, which disables this and reads the files with `diskCacheReadingOptions`.
+ * The pack file layout always maps its segments.
+ */
+@property (assign, nonatomic) NSUInteger diskCacheMappingThreshold;
+
 /**
  * The maximum length of time to keep an image in the cache, in seconds.
  */
 @property (assign, nonatomic) NSInteger maxCacheAge;
 
+/**
+ * The eviction policy of the memory cache [defaults to YSCImageCacheEvictionPolicyLeastRecentlyUsed]
+ */
+@property (assign, nonatomic) YSCImageCacheEvictionPolicy memoryCacheEvictionPolicy;
+
+/**
+ * The eviction policy of the disk cache, for the file per key layout. The pack file layout always evicts
+ * the least recently used images [defaults to YSCImageCacheEvictionPolicyLeastRecentlyUsed]
+ */
+@property (assign, nonatomic) YSCImageCacheEvictionPolicy diskCacheEvictionPolicy;
+
 /**
  * The maximum size of the cache, in bytes.
  */
 @property (assign, nonatomic) NSUInteger maxCacheSize;
 
+/**
+ * The maximum number of images in the disk cache. Defaults to 0, which means no limit.
+ */
+@property (assign, nonatomic) NSUInteger maxCacheCount;
+
+/**
+ * The fraction of `maxCacheSize` and `maxCacheCount` above which the disk cache starts evicting
+ * the least recently used images [defaults to 1.0]
+ */
+@property (assign, nonatomic) double diskCacheHighWatermark;
+
+/**
+ * The fraction of `maxCacheSize` and `maxCacheCount` the disk cache evicts down to, a few images at a time
+ * [defaults to 0.8]
+ */
+@property (assign, nonatomic) double diskCacheLowWatermark;
+
+/**
+ * The number of IO queues the disk cache work is spread across, chosen by key digest [defaults to 4]
+ * Reads and stores of a shard run concurrently, removals only block the reads of their own shard.
+ * Set this before the cache is first used.
+ */
+@property (assign, nonatomic) NSUInteger diskCacheShardCount;
+
+/**
+ * The way images are laid out in the disk cache directory [defaults to YSCImageCacheDiskLayoutFilePerKey]
+ * Set this before the cache is first used, images stored with the other layout won't be found.
+ */
+@property (assign, nonatomic) YSCImageCacheDiskLayout diskCacheLayout;
+
+/**
+ * The size a pack file segment can grow to before a new one is started, in bytes [defaults to 32 MB]
+ * Only used with `YSCImageCacheDiskLayoutPackFile`.
+ */
+@property (assign, nonatomic) NSUInteger diskCachePackSegmentSize;
+
+/**
+ * The format the images stored without data are encoded to. Defaults to YSCImageFormatUndefined, which picks
+ * PNG for images with alpha and JPEG for the others. Set YSCImageFormatWebP for lossy WebP, it needs the WebP coder
+ * to be added to the coders manager.
+ */
+@property (assign, nonatomic) YSCImageFormat diskCacheEncodeFormat;
+
+/**
+ * The compression quality of the lossy encodings, from 0 to 1 [defaults to 1]
+ */
+@property (assign, nonatomic) double diskCacheEncodeQuality;
+
+/**
+ * The maximum number of images encoded at the same time [defaults to 2]
+ */
+@property (assign, nonatomic) NSUInteger diskCacheEncodeConcurrency;
+
+/**
+ * How long a store waits in the write buffer before the pending writes are flushed to disk together, in seconds.
+ * A key stored again meanwhile is only written once [defaults to 0.05]
+ */
+@property (assign, nonatomic) NSTimeInterval diskCacheWriteDelay;
+
+/**
+ * The number of pending writes that flushes the write buffer without waiting for `diskCacheWriteDelay` [defaults to 32]
+ */
+@property (assign, nonatomic) NSUInteger diskCacheWriteBatchCount;
+
+/**
+ * The size of the pending writes that flushes the write buffer without waiting for `diskCacheWriteDelay`, in bytes
+ * [defaults to 4 MB]
+ */
+@property (assign, nonatomic) NSUInteger diskCacheWriteBatchSize;
+
+/**
+ * Record the hits, the misses, the IO queue waits and the latencies returned by `-[YSCImageCache metricsByResetting:]`.
+ * Costs a few atomic increments per operation [defaults to NO]
+ */
+@property (assign, nonatomic) BOOL shouldCollectMetrics;
+
 @end
@@ -9,6 +9,8 @@
 #import "YSCImageCacheConfig.h"
 
 static const NSInteger kDefaultCacheMaxCacheAge = 60 * 60 * 24 * 7; // 1 week
+static const NSUInteger kDefaultDiskCachePackSegmentSize = 32 * 1024 * 1024; // 32 MB
+static const NSUInteger kDefaultDiskCacheWriteBatchSize = 4 * 1024 * 1024; // 4 MB
 
 @implementation YSCImageCacheConfig
 
@@ -17,9 +19,30 @@ static const NSInteger kDefaultCacheMaxCacheAge = 60 * 60 * 24 * 7; // 1 week
         _shouldDecompressImages = YES;
         _shouldDisableiCloud = YES;
         _shouldCacheImagesInMemory = YES;
+        _shouldCacheImageDataInMemory = YES;
+        _memoryCacheRatioKeptOnMemoryWarning = 0;
+        _memoryCacheHotSetCost = 0;
         _diskCacheReadingOptions = 0;
+        _diskCacheMappingThreshold = 0;
+        _shouldReadLegacyDiskCacheFileNames = YES;
+        _shouldVerifyDiskCacheChecksums = YES;
         _maxCacheAge = kDefaultCacheMaxCacheAge;
+        _memoryCacheEvictionPolicy = YSCImageCacheEvictionPolicyLeastRecentlyUsed;
+        _diskCacheEvictionPolicy = YSCImageCacheEvictionPolicyLeastRecentlyUsed;
         _maxCacheSize = 0;
+        _maxCacheCount = 0;
+        _diskCacheHighWatermark = 1.0;
+        _diskCacheLowWatermark = 0.8;
+        _diskCacheShardCount = 4;
+        _diskCacheLayout = YSCImageCacheDiskLayoutFilePerKey;
+        _diskCachePackSegmentSize = kDefaultDiskCachePackSegmentSize;
+        _diskCacheEncodeFormat = YSCImageFormatUndefined;
+        _diskCacheEncodeQuality = 1.0;
+        _diskCacheEncodeConcurrency = 2;
+        _diskCacheWriteDelay = 0.05;
+        _diskCacheWriteBatchCount = 32;
+        _diskCacheWriteBatchSize = kDefaultDiskCacheWriteBatchSize;
+        _shouldCollectMetrics = NO;
     }
     return self;
 }
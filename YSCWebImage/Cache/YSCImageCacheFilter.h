@@ -0,0 +1,74 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+#import "YSCImageCacheKey.h"
+
+/**
+ * Negative lookup filter of a disk cache directory, a counting Bloom filter of the digests the file names are made of.
+ *
+ * When `mayContainDigest:` returns NO, no file of the directory is named after the digest, so the lookup can skip
+ * the directory without any syscall. A YES may be a false positive.
+ *
+ * The filter answers YES to everything until it's built. It must be built from a snapshot of the directory taken
+ * along with `beginBuilding`, no digest being added or removed in between. The digests added and removed after it are
+ * applied on top of the snapshot.
+ *
+ * All the methods are thread safe.
+ */
+@interface YSCImageCacheFilter : NSObject
+
+/**
+ * Whether the filter has been built
+ */
+@property (assign, readonly, getter=isBuilt) BOOL built;
+
+/**
+ * The number of digests in the filter
+ */
+@property (assign, readonly) NSUInteger count;
+
+/**
+ * The number of digests the filter was sized for, it should be rebuilt once `count` goes over it
+ */
+@property (assign, readonly) NSUInteger capacity;
+
+/**
+ * Start recording the added digests, before taking the snapshot of the directory.
+ */
+- (void)beginBuilding;
+
+/**
+ * Replace the content of the filter with the digests of the snapshot, plus the digests added and minus the digests
+ * removed since `beginBuilding`.
+ */
+- (void)finishBuildingWithDigests:(nonnull NSData *)digests;
+
+/**
+ * Build an empty filter, for a directory that was just cleared.
+ */
+- (void)removeAllDigests;
+
+- (void)addDigest:(YSCImageCacheKeyDigest)digest;
+
+/**
+ * Remove a digest. Only the digests that were added can be removed, or the filter gets false negatives.
+ */
+- (void)removeDigest:(YSCImageCacheKeyDigest)digest;
+
+- (BOOL)mayContainDigest:(YSCImageCacheKeyDigest)digest;
+
+/**
+ * Parse the digest a cache file name starts with, the 32 hex digits before the optional extension.
+ *
+ * @return NO if the file name is not made of a digest
+ */
++ (BOOL)getDigest:(nonnull YSCImageCacheKeyDigest *)digest fromFileName:(nonnull NSString *)fileName;
+
+@end
@@ -0,0 +1,223 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCacheFilter.h"
+#import <pthread.h>
+
+// 10 counters and 7 probes per digest give a false positive rate below 1%
+static const NSUInteger kYSCFilterCountersPerDigest = 10;
+static const NSUInteger kYSCFilterProbeCount = 7;
+static const NSUInteger kYSCFilterMinimumCapacity = 1024;
+
+@implementation YSCImageCacheFilter {
+    pthread_mutex_t _lock;
+    uint8_t *_counters;
+    size_t _counterMask;
+    BOOL _built;
+    BOOL _building;
+    NSUInteger _count;
+    NSUInteger _capacity;
+    // The digests added and removed since beginBuilding
+    NSMutableData *_pendingDigests;
+    NSMutableData *_pendingRemovedDigests;
+}
+
+- (nonnull instancetype)init {
+    if ((self = [super init])) {
+        pthread_mutex_init(&_lock, NULL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    free(_counters);
+    pthread_mutex_destroy(&_lock);
+}
+
+#pragma mark - Building
+
+- (void)beginBuilding {
+    pthread_mutex_lock(&_lock);
+    _building = YES;
+    _pendingDigests = [NSMutableData data];
+    _pendingRemovedDigests = [NSMutableData data];
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)finishBuildingWithDigests:(nonnull NSData *)digests {
+    pthread_mutex_lock(&_lock);
+    NSUInteger snapshotCount = digests.length / sizeof(YSCImageCacheKeyDigest);
+    NSUInteger pendingCount = _pendingDigests.length / sizeof(YSCImageCacheKeyDigest);
+    [self resetWithCapacity:MAX((snapshotCount + pendingCount) * 2, kYSCFilterMinimumCapacity)];
+    const YSCImageCacheKeyDigest *snapshot = digests.bytes;
+    for (NSUInteger i = 0; i < snapshotCount; i++) {
+        [self lockedAddDigest:snapshot[i]];
+    }
+    const YSCImageCacheKeyDigest *pending = _pendingDigests.bytes;
+    for (NSUInteger i = 0; i < pendingCount; i++) {
+        [self lockedAddDigest:pending[i]];
+    }
+    // removed since the snapshot, or added and removed since beginBuilding, they were counted above either way
+    const YSCImageCacheKeyDigest *removed = _pendingRemovedDigests.bytes;
+    NSUInteger removedCount = _pendingRemovedDigests.length / sizeof(YSCImageCacheKeyDigest);
+    for (NSUInteger i = 0; i < removedCount; i++) {
+        [self lockedRemoveDigest:removed[i]];
+    }
+    _pendingDigests = nil;
+    _pendingRemovedDigests = nil;
+    _building = NO;
+    _built = YES;
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)removeAllDigests {
+    pthread_mutex_lock(&_lock);
+    [self resetWithCapacity:kYSCFilterMinimumCapacity];
+    _pendingDigests = nil;
+    _pendingRemovedDigests = nil;
+    _building = NO;
+    _built = YES;
+    pthread_mutex_unlock(&_lock);
+}
+
+// The lock must be held
+- (void)resetWithCapacity:(NSUInteger)capacity {
+    size_t counterCount = 1;
+    while (counterCount < capacity * kYSCFilterCountersPerDigest) {
+        counterCount <<= 1;
+    }
+    free(_counters);
+    _counters = calloc(counterCount, sizeof(uint8_t));
+    _counterMask = counterCount - 1;
+    _capacity = capacity;
+    _count = 0;
+}
+
+#pragma mark - Digests
+
+// Double hashing, the two halves of the digest are independent enough to derive all the probes
+#define YSC_FILTER_PROBE(digest, i) (((digest).high + (i) * ((digest).low | 1)) & _counterMask)
+
+- (void)addDigest:(YSCImageCacheKeyDigest)digest {
+    pthread_mutex_lock(&_lock);
+    if (_building) {
+        [_pendingDigests appendBytes:&digest length:sizeof(digest)];
+    }
+    if (_built) {
+        [self lockedAddDigest:digest];
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)lockedAddDigest:(YSCImageCacheKeyDigest)digest {
+    for (uint64_t i = 0; i < kYSCFilterProbeCount; i++) {
+        uint8_t *counter = &_counters[YSC_FILTER_PROBE(digest, i)];
+        // a saturated counter sticks, it can't tell how many digests it holds anymore
+        if (*counter < UINT8_MAX) {
+            (*counter)++;
+        }
+    }
+    _count++;
+}
+
+- (void)removeDigest:(YSCImageCacheKeyDigest)digest {
+    pthread_mutex_lock(&_lock);
+    if (_building) {
+        [_pendingRemovedDigests appendBytes:&digest length:sizeof(digest)];
+    }
+    if (_built) {
+        [self lockedRemoveDigest:digest];
+    }
+    pthread_mutex_unlock(&_lock);
+}
+
+- (void)lockedRemoveDigest:(YSCImageCacheKeyDigest)digest {
+    for (uint64_t i = 0; i < kYSCFilterProbeCount; i++) {
+        uint8_t *counter = &_counters[YSC_FILTER_PROBE(digest, i)];
+        if (*counter > 0 && *counter < UINT8_MAX) {
+            (*counter)--;
+        }
+    }
+    if (_count > 0) {
+        _count--;
+    }
+}
+
+- (BOOL)mayContainDigest:(YSCImageCacheKeyDigest)digest {
+    BOOL contains = YES;
+    pthread_mutex_lock(&_lock);
+    if (_built) {
+        for (uint64_t i = 0; i < kYSCFilterProbeCount; i++) {
+            if (_counters[YSC_FILTER_PROBE(digest, i)] == 0) {
+                contains = NO;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+    return contains;
+}
+
+#pragma mark - Info
+
+- (BOOL)isBuilt {
+    pthread_mutex_lock(&_lock);
+    BOOL built = _built;
+    pthread_mutex_unlock(&_lock);
+    return built;
+}
+
+- (NSUInteger)count {
+    pthread_mutex_lock(&_lock);
+    NSUInteger count = _count;
+    pthread_mutex_unlock(&_lock);
+    return count;
+}
+
+- (NSUInteger)capacity {
+    pthread_mutex_lock(&_lock);
+    NSUInteger capacity = _capacity;
+    pthread_mutex_unlock(&_lock);
+    return capacity;
+}
+
+#pragma mark - File names
+
+static inline int YSCHexDigitValue(unichar c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
++ (BOOL)getDigest:(nonnull YSCImageCacheKeyDigest *)digest fromFileName:(nonnull NSString *)fileName {
+    if (fileName.length < 32 || (fileName.length > 32 && [fileName characterAtIndex:32] != '.')) {
+        return NO;
+    }
+    unichar characters[32];
+    [fileName getCharacters:characters range:NSMakeRange(0, 32)];
+    uint64_t halves[2] = {0, 0};
+    for (NSUInteger i = 0; i < 32; i++) {
+        int value = YSCHexDigitValue(characters[i]);
+        if (value < 0) {
+            return NO;
+        }
+        halves[i / 16] = (halves[i / 16] << 4) | (uint64_t)value;
+    }
+    digest->high = halves[0];
+    digest->low = halves[1];
+    return YES;
+}
+
+@end
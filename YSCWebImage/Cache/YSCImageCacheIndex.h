@@ -0,0 +1,158 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * The checksum of the content of a cache file, never 0.
+ */
+FOUNDATION_EXPORT uint64_t YSCImageCacheChecksumMake(NSData * _Nullable data);
+
+/**
+ * An entry of the disk cache index, describing one cache file.
+ * Times are in seconds since 1970.
+ * An entry is not modified once it's in the index, a change sets a copy, so the entries handed out can be read from
+ * any thread.
+ */
+@interface YSCImageCacheIndexEntry : NSObject <NSCopying>
+
+/**
+ * The name of the cache file, relative to the cache directory
+ */
+@property (nonatomic, copy, nonnull) NSString *fileName;
+
+/**
+ * The cache key. Empty for the files found on disk before the index existed.
+ */
+@property (nonatomic, copy, nonnull) NSString *key;
+
+/**
+ * The size of the file, in bytes
+ */
+@property (nonatomic, assign) NSUInteger size;
+
+/**
+ * When the file was written
+ */
+@property (nonatomic, assign) NSTimeInterval modificationTime;
+
+/**
+ * When the file was last read
+ */
+@property (nonatomic, assign) NSTimeInterval accessTime;
+
+/**
+ * When the file expires, 0 means it follows the `maxCacheAge` of the cache config
+ */
+@property (nonatomic, assign) NSTimeInterval expirationTime;
+
+/**
+ * The checksum of the content of the file, 0 when unknown for the files found on disk before the index existed
+ */
+@property (nonatomic, assign) uint64_t checksum;
+
+@end
+
+/**
+ * Persistent index of the files in a disk cache directory, so size queries and cleanups don't need to enumerate it.
+ *
+ * The index is an append-only journal, every change writes one small record. The journal is rewritten once it holds
+ * much more records than live entries. When there's no journal yet, the directory is scanned once to build it.
+ *
+ * All the methods are thread safe. The index is loaded from disk the first time it's used.
+ */
+@interface YSCImageCacheIndex : NSObject
+
+/**
+ * The path of the journal file
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *path;
+
+/**
+ * The cache directory, scanned when there's no journal yet
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *directory;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Init a new index.
+ *
+ * @param path      The path of the journal file. Hidden files of the directory are never indexed.
+ * @param directory The cache directory the index describes
+ */
+- (nonnull instancetype)initWithPath:(nonnull NSString *)path directory:(nonnull NSString *)directory NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Add or replace the entry for its file name.
+ *
+ * @return YES if there was no entry for the file name
+ */
+- (BOOL)setEntry:(nonnull YSCImageCacheIndexEntry *)entry;
+
+/**
+ * Get the entry for a file name.
+ */
+- (nullable YSCImageCacheIndexEntry *)entryForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Record a read of the file. Access times have a one minute resolution, so a burst of reads writes a single record.
+ */
+- (void)touchEntryForFileName:(nonnull NSString *)fileName;
+
+/**
+ * The least recently used entries to remove so the index fits in the size and the count, at most `limit` of them.
+ * The entries are not removed from the index. Consecutive calls continue from the same ordering, skipping
+ * the entries that have been read or replaced since.
+ *
+ * @param size  The total size to fit in, in bytes
+ * @param count The number of entries to fit in
+ * @param limit The maximum number of entries to return
+ */
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)leastRecentlyUsedEntriesExceedingSize:(NSUInteger)size
+                                                                                 count:(NSUInteger)count
+                                                                                 limit:(NSUInteger)limit;
+
+/**
+ * Same as `leastRecentlyUsedEntriesExceedingSize:count:limit:`, optionally ordered by size times time since
+ * the last read instead of the time alone, so a large file goes before a few small ones read at about the same time.
+ */
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)leastRecentlyUsedEntriesExceedingSize:(NSUInteger)size
+                                                                                 count:(NSUInteger)count
+                                                                                 limit:(NSUInteger)limit
+                                                                          sizeWeighted:(BOOL)sizeWeighted;
+
+/**
+ * Remove the entry for a file name.
+ *
+ * @return YES if there was an entry for the file name
+ */
+- (BOOL)removeEntryForFileName:(nonnull NSString *)fileName;
+
+/**
+ * Remove all the entries and the journal.
+ */
+- (void)removeAllEntries;
+
+/**
+ * A snapshot of all the entries.
+ */
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)allEntries;
+
+/**
+ * The total size of the indexed files, in bytes.
+ */
+- (NSUInteger)totalSize;
+
+/**
+ * The number of indexed files.
+ */
+- (NSUInteger)totalCount;
+
+@end
@@ -0,0 +1,412 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCacheIndex.h"
+#import "YSCImageCacheKey.h"
+#import <fcntl.h>
+#import <unistd.h>
+
+static const uint32_t kYSCIndexRecordMagic = 0x32495359; // "YSI2", bump the last digit when the record changes
+// The records written before the checksum was added, still read
+static const uint32_t kYSCIndexRecordMagicV1 = 0x31495359; // "YSI1"
+static const uint32_t kYSCIndexRecordOpSet = 1;
+static const uint32_t kYSCIndexRecordOpRemove = 2;
+// The journal is rewritten once it holds more than twice the live entries plus this slack
+static const NSUInteger kYSCIndexJournalSlack = 1024;
+static const NSTimeInterval kYSCIndexAccessTimeResolution = 60;
+
+// Every record is a header followed by the UTF-8 file name and key
+typedef struct YSCIndexRecordHeader {
+    uint32_t magic;
+    uint32_t op;
+    uint32_t fileNameLength;
+    uint32_t keyLength;
+    uint64_t size;
+    double modificationTime;
+    double accessTime;
+    double expirationTime;
+    uint64_t checksum;
+} YSCIndexRecordHeader;
+
+uint64_t YSCImageCacheChecksumMake(NSData * _Nullable data) {
+    uint64_t checksum = YSCImageCacheKeyDigestMake(data.bytes, data.length).low;
+    return checksum != 0 ? checksum : 1;
+}
+
+@implementation YSCImageCacheIndexEntry
+
+- (id)copyWithZone:(NSZone *)zone {
+    YSCImageCacheIndexEntry *entry = [[[self class] allocWithZone:zone] init];
+    entry.fileName = self.fileName;
+    entry.key = self.key;
+    entry.size = self.size;
+    entry.modificationTime = self.modificationTime;
+    entry.accessTime = self.accessTime;
+    entry.expirationTime = self.expirationTime;
+    entry.checksum = self.checksum;
+    return entry;
+}
+
+@end
+
+@interface YSCImageCacheIndex ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *path;
+@property (nonatomic, copy, readwrite, nonnull) NSString *directory;
+
+@end
+
+@implementation YSCImageCacheIndex {
+    NSMutableDictionary<NSString *, YSCImageCacheIndexEntry *> *_entries;
+    NSUInteger _totalSize;
+    NSUInteger _journalRecordCount;
+    int _journalFileDescriptor;
+    BOOL _loaded;
+    // Least recently used first, consumed by the successive trim calls
+    NSArray<YSCImageCacheIndexEntry *> *_trimCandidates;
+    NSUInteger _trimCandidatesPosition;
+    NSTimeInterval _trimCandidatesTime;
+    BOOL _trimCandidatesSizeWeighted;
+}
+
+- (nonnull instancetype)initWithPath:(nonnull NSString *)path directory:(nonnull NSString *)directory {
+    if ((self = [super init])) {
+        _path = [path copy];
+        _directory = [directory copy];
+        _entries = [NSMutableDictionary dictionary];
+        _journalFileDescriptor = -1;
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_journalFileDescriptor >= 0) {
+        close(_journalFileDescriptor);
+    }
+}
+
+#pragma mark - Loading
+
+// Must be called with the lock held
+- (void)loadIfNeeded {
+    if (_loaded) {
+        return;
+    }
+    _loaded = YES;
+
+    NSData *journal = [NSData dataWithContentsOfFile:self.path options:NSDataReadingMappedIfSafe error:nil];
+    if (journal) {
+        uint64_t validLength = [self replayJournal:journal];
+        if (validLength < journal.length) {
+            // Drop the torn record left by an interrupted write
+            truncate(self.path.fileSystemRepresentation, (off_t)validLength);
+        }
+    } else {
+        [self buildFromDirectory];
+        [self rewriteJournal];
+    }
+}
+
+// Must be called with the lock held
+- (uint64_t)replayJournal:(NSData *)journal {
+    const uint8_t *bytes = journal.bytes;
+    uint64_t length = journal.length;
+    uint64_t offset = 0;
+
+    while (offset + sizeof(uint32_t) <= length) {
+        YSCIndexRecordHeader header = {0};
+        memcpy(&header.magic, bytes + offset, sizeof(header.magic));
+        // the version 1 header is the same without the checksum
+        size_t headerLength = header.magic == kYSCIndexRecordMagicV1 ? offsetof(YSCIndexRecordHeader, checksum) : sizeof(header);
+        if ((header.magic != kYSCIndexRecordMagic && header.magic != kYSCIndexRecordMagicV1) || offset + headerLength > length) {
+            break;
+        }
+        memcpy(&header, bytes + offset, headerLength);
+        uint64_t recordLength = headerLength + (uint64_t)header.fileNameLength + header.keyLength;
+        if (offset + recordLength > length) {
+            break;
+        }
+        const uint8_t *strings = bytes + offset + headerLength;
+        NSString *fileName = [[NSString alloc] initWithBytes:strings length:header.fileNameLength encoding:NSUTF8StringEncoding];
+        NSString *key = [[NSString alloc] initWithBytes:strings + header.fileNameLength length:header.keyLength encoding:NSUTF8StringEncoding];
+        if (!fileName || !key) {
+            break;
+        }
+
+        if (header.op == kYSCIndexRecordOpSet) {
+            YSCImageCacheIndexEntry *entry = [YSCImageCacheIndexEntry new];
+            entry.fileName = fileName;
+            entry.key = key;
+            entry.size = (NSUInteger)header.size;
+            entry.modificationTime = header.modificationTime;
+            entry.accessTime = header.accessTime;
+            entry.expirationTime = header.expirationTime;
+            entry.checksum = header.checksum;
+            [self replaceEntry:entry forFileName:fileName];
+        } else {
+            [self replaceEntry:nil forFileName:fileName];
+        }
+        _journalRecordCount++;
+        offset += recordLength;
+    }
+    return offset;
+}
+
+// Must be called with the lock held
+- (void)buildFromDirectory {
+    NSURL *directoryURL = [NSURL fileURLWithPath:self.directory isDirectory:YES];
+    NSArray<NSString *> *resourceKeys = @[NSURLIsDirectoryKey, NSURLContentModificationDateKey, NSURLFileSizeKey];
+    NSDirectoryEnumerator *fileEnumerator = [[NSFileManager new] enumeratorAtURL:directoryURL
+                                                      includingPropertiesForKeys:resourceKeys
+                                                                         options:NSDirectoryEnumerationSkipsHiddenFiles | NSDirectoryEnumerationSkipsSubdirectoryDescendants
+                                                                    errorHandler:NULL];
+    for (NSURL *fileURL in fileEnumerator) {
+        NSDictionary<NSString *, id> *resourceValues = [fileURL resourceValuesForKeys:resourceKeys error:nil];
+        if (!resourceValues || [resourceValues[NSURLIsDirectoryKey] boolValue]) {
+            continue;
+        }
+        NSTimeInterval modificationTime = [resourceValues[NSURLContentModificationDateKey] timeIntervalSince1970];
+        YSCImageCacheIndexEntry *entry = [YSCImageCacheIndexEntry new];
+        entry.fileName = fileURL.lastPathComponent;
+        entry.key = @"";
+        entry.size = [resourceValues[NSURLFileSizeKey] unsignedIntegerValue];
+        entry.modificationTime = modificationTime;
+        entry.accessTime = modificationTime;
+        [self replaceEntry:entry forFileName:entry.fileName];
+    }
+}
+
+#pragma mark - Journal
+
+// Must be called with the lock held
+- (BOOL)openJournalIfNeeded {
+    if (_journalFileDescriptor >= 0) {
+        return YES;
+    }
+    NSString *directory = self.path.stringByDeletingLastPathComponent;
+    [[NSFileManager new] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+    _journalFileDescriptor = open(self.path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    return _journalFileDescriptor >= 0;
+}
+
+// Must be called with the lock held
+- (void)closeJournal {
+    if (_journalFileDescriptor >= 0) {
+        close(_journalFileDescriptor);
+        _journalFileDescriptor = -1;
+    }
+}
+
+static void YSCAppendIndexRecord(NSMutableData *buffer, uint32_t op, YSCImageCacheIndexEntry *entry, NSString *fileName) {
+    NSData *fileNameData = [fileName dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *keyData = [entry.key dataUsingEncoding:NSUTF8StringEncoding];
+    YSCIndexRecordHeader header;
+    header.magic = kYSCIndexRecordMagic;
+    header.op = op;
+    header.fileNameLength = (uint32_t)fileNameData.length;
+    header.keyLength = (uint32_t)keyData.length;
+    header.size = entry.size;
+    header.modificationTime = entry.modificationTime;
+    header.accessTime = entry.accessTime;
+    header.expirationTime = entry.expirationTime;
+    header.checksum = entry.checksum;
+    [buffer appendBytes:&header length:sizeof(header)];
+    [buffer appendData:fileNameData];
+    if (keyData) {
+        [buffer appendData:keyData];
+    }
+}
+
+// Must be called with the lock held
+- (void)appendRecordWithOp:(uint32_t)op entry:(nullable YSCImageCacheIndexEntry *)entry fileName:(NSString *)fileName {
+    if (![self openJournalIfNeeded]) {
+        return;
+    }
+    NSMutableData *record = [NSMutableData dataWithCapacity:sizeof(YSCIndexRecordHeader) + fileName.length + entry.key.length];
+    YSCAppendIndexRecord(record, op, entry, fileName);
+    if (write(_journalFileDescriptor, record.bytes, record.length) != (ssize_t)record.length) {
+        // The journal may end with a torn record now, rewrite it from memory
+        [self rewriteJournal];
+        return;
+    }
+    _journalRecordCount++;
+
+    if (_journalRecordCount > _entries.count * 2 + kYSCIndexJournalSlack) {
+        [self rewriteJournal];
+    }
+}
+
+// Must be called with the lock held
+- (void)rewriteJournal {
+    NSMutableData *journal = [NSMutableData dataWithCapacity:_entries.count * (sizeof(YSCIndexRecordHeader) + 64)];
+    for (YSCImageCacheIndexEntry *entry in _entries.allValues) {
+        YSCAppendIndexRecord(journal, kYSCIndexRecordOpSet, entry, entry.fileName);
+    }
+    [self closeJournal];
+    [[NSFileManager new] createDirectoryAtPath:self.path.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:NULL];
+    [journal writeToFile:self.path atomically:YES];
+    _journalRecordCount = _entries.count;
+}
+
+#pragma mark - Entries
+
+// Must be called with the lock held
+- (void)replaceEntry:(nullable YSCImageCacheIndexEntry *)entry forFileName:(NSString *)fileName {
+    YSCImageCacheIndexEntry *oldEntry = _entries[fileName];
+    if (oldEntry) {
+        _totalSize -= oldEntry.size;
+    }
+    if (entry) {
+        _totalSize += entry.size;
+    }
+    _entries[fileName] = entry;
+}
+
+- (BOOL)setEntry:(nonnull YSCImageCacheIndexEntry *)entry {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        BOOL added = _entries[entry.fileName] == nil;
+        [self replaceEntry:entry forFileName:entry.fileName];
+        [self appendRecordWithOp:kYSCIndexRecordOpSet entry:entry fileName:entry.fileName];
+        return added;
+    }
+}
+
+- (nullable YSCImageCacheIndexEntry *)entryForFileName:(nonnull NSString *)fileName {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _entries[fileName];
+    }
+}
+
+- (void)touchEntryForFileName:(nonnull NSString *)fileName {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        YSCImageCacheIndexEntry *entry = _entries[fileName];
+        NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+        if (!entry || now - entry.accessTime < kYSCIndexAccessTimeResolution) {
+            return;
+        }
+        // The entry may be read by the maintenance queue without the lock, the touched one replaces it
+        YSCImageCacheIndexEntry *touchedEntry = [entry copy];
+        touchedEntry.accessTime = now;
+        [self replaceEntry:touchedEntry forFileName:fileName];
+        [self appendRecordWithOp:kYSCIndexRecordOpSet entry:touchedEntry fileName:fileName];
+    }
+}
+
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)leastRecentlyUsedEntriesExceedingSize:(NSUInteger)size
+                                                                                 count:(NSUInteger)count
+                                                                                 limit:(NSUInteger)limit {
+    return [self leastRecentlyUsedEntriesExceedingSize:size count:count limit:limit sizeWeighted:NO];
+}
+
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)leastRecentlyUsedEntriesExceedingSize:(NSUInteger)size
+                                                                                 count:(NSUInteger)count
+                                                                                 limit:(NSUInteger)limit
+                                                                          sizeWeighted:(BOOL)sizeWeighted {
+    @synchronized (self) {
+        if (sizeWeighted != _trimCandidatesSizeWeighted) {
+            _trimCandidates = nil;
+            _trimCandidatesSizeWeighted = sizeWeighted;
+        }
+        [self loadIfNeeded];
+        NSMutableArray<YSCImageCacheIndexEntry *> *entries = [NSMutableArray array];
+        NSUInteger remainingSize = _totalSize;
+        NSUInteger remainingCount = _entries.count;
+        BOOL sorted = NO;
+
+        while (entries.count < limit && (remainingSize > size || remainingCount > count)) {
+            if (_trimCandidatesPosition >= _trimCandidates.count) {
+                if (sorted) {
+                    break;
+                }
+                // Sorting is the expensive part, so it's done once for all the steps of a trim
+                NSTimeInterval now = [[NSDate date] timeIntervalSince1970];
+                _trimCandidates = [_entries.allValues sortedArrayUsingComparator:^NSComparisonResult(YSCImageCacheIndexEntry *entry1, YSCImageCacheIndexEntry *entry2) {
+                    // the heaviest or the oldest first, compared unboxed since the whole index is sorted
+                    double order1, order2;
+                    if (sizeWeighted) {
+                        // the access times have a one minute resolution, so a file just read still has an age
+                        order1 = -(now - entry1.accessTime + kYSCIndexAccessTimeResolution) * MAX(entry1.size, 1);
+                        order2 = -(now - entry2.accessTime + kYSCIndexAccessTimeResolution) * MAX(entry2.size, 1);
+                    } else {
+                        order1 = entry1.accessTime;
+                        order2 = entry2.accessTime;
+                    }
+                    if (order1 < order2) {
+                        return NSOrderedAscending;
+                    }
+                    return order1 > order2 ? NSOrderedDescending : NSOrderedSame;
+                }];
+                _trimCandidatesPosition = 0;
+                _trimCandidatesTime = now;
+                sorted = YES;
+                continue;
+            }
+
+            YSCImageCacheIndexEntry *entry = _trimCandidates[_trimCandidatesPosition++];
+            if (_entries[entry.fileName] != entry || entry.accessTime > _trimCandidatesTime) {
+                // removed, replaced or read since the candidates were sorted
+                continue;
+            }
+            [entries addObject:entry];
+            remainingSize -= MIN(remainingSize, entry.size);
+            remainingCount--;
+        }
+        return entries;
+    }
+}
+
+- (BOOL)removeEntryForFileName:(nonnull NSString *)fileName {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        if (!_entries[fileName]) {
+            return NO;
+        }
+        [self replaceEntry:nil forFileName:fileName];
+        [self appendRecordWithOp:kYSCIndexRecordOpRemove entry:nil fileName:fileName];
+        return YES;
+    }
+}
+
+- (void)removeAllEntries {
+    @synchronized (self) {
+        [self closeJournal];
+        [_entries removeAllObjects];
+        _trimCandidates = nil;
+        _totalSize = 0;
+        _journalRecordCount = 0;
+        // An empty journal, not a missing one, so the next load doesn't scan the directory
+        [[NSData data] writeToFile:self.path atomically:YES];
+        _loaded = YES;
+    }
+}
+
+- (nonnull NSArray<YSCImageCacheIndexEntry *> *)allEntries {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _entries.allValues;
+    }
+}
+
+- (NSUInteger)totalSize {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _totalSize;
+    }
+}
+
+- (NSUInteger)totalCount {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _entries.count;
+    }
+}
+
+@end
@@ -0,0 +1,75 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * 128 bit digest of a cache key
+ */
+typedef struct YSCImageCacheKeyDigest {
+    uint64_t high;
+    uint64_t low;
+} YSCImageCacheKeyDigest;
+
+/**
+ * Compute the digest of the bytes, a non cryptographic 128 bit hash (MurmurHash3 x64 128).
+ */
+FOUNDATION_EXPORT YSCImageCacheKeyDigest YSCImageCacheKeyDigestMake(const void * _Nullable bytes, size_t length);
+
+/**
+ * A cache key with its digest and its disk file names, computed once per request and passed along
+ * the store and query paths.
+ */
+@interface YSCImageCacheKey : NSObject
+
+/**
+ * The cache key
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *key;
+
+/**
+ * The digest of the UTF-8 key
+ */
+@property (nonatomic, assign, readonly) YSCImageCacheKeyDigest digest;
+
+/**
+ * The file name: the hex digest, plus the path extension of the key if it has one
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *fileName;
+
+/**
+ * The file name without the path extension, the name used by old versions of the cache
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *fileNameWithoutExtension;
+
+/**
+ * The file name used before the digest changed, named after the MD5 of the key. Computed on first use.
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *legacyFileName;
+
+/**
+ * The MD5 digest of the key the legacy file name is made of. Computed on first use.
+ */
+@property (nonatomic, assign, readonly) YSCImageCacheKeyDigest legacyDigest;
+
+/**
+ * The legacy file name without the path extension
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *legacyFileNameWithoutExtension;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Init a new cache key, a nil key is hashed as an empty string.
+ */
+- (nonnull instancetype)initWithKey:(nullable NSString *)key NS_DESIGNATED_INITIALIZER;
+
++ (nonnull instancetype)keyWithString:(nullable NSString *)key;
+
+@end
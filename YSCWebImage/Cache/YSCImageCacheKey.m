@@ -0,0 +1,167 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCacheKey.h"
+#import <CommonCrypto/CommonDigest.h>
+
+#pragma mark - Digest
+
+static inline uint64_t YSCRotateLeft64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t YSCFinalMix64(uint64_t k) {
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+// Little endian read, so the file names are the same on every platform
+static inline uint64_t YSCReadLittleEndian64(const uint8_t *bytes) {
+    uint64_t value;
+    memcpy(&value, bytes, sizeof(value));
+    return CFSwapInt64LittleToHost(value);
+}
+
+YSCImageCacheKeyDigest YSCImageCacheKeyDigestMake(const void * _Nullable bytes, size_t length) {
+    static const uint64_t c1 = 0x87c37b91114253d5ULL;
+    static const uint64_t c2 = 0x4cf5ad432745937fULL;
+    const uint8_t *data = bytes;
+    uint64_t h1 = 0;
+    uint64_t h2 = 0;
+
+    size_t blockCount = length / 16;
+    for (size_t i = 0; i < blockCount; i++) {
+        uint64_t k1 = YSCReadLittleEndian64(data + i * 16);
+        uint64_t k2 = YSCReadLittleEndian64(data + i * 16 + 8);
+
+        k1 *= c1; k1 = YSCRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+        h1 = YSCRotateLeft64(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+
+        k2 *= c2; k2 = YSCRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+        h2 = YSCRotateLeft64(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+    }
+
+    // The tail is zero padded, which gives the same result as the byte by byte switch of the reference implementation
+    size_t tailLength = length & 15;
+    if (tailLength > 0) {
+        uint8_t tail[16] = {0};
+        memcpy(tail, data + blockCount * 16, tailLength);
+        if (tailLength > 8) {
+            uint64_t k2 = YSCReadLittleEndian64(tail + 8);
+            k2 *= c2; k2 = YSCRotateLeft64(k2, 33); k2 *= c1; h2 ^= k2;
+        }
+        uint64_t k1 = YSCReadLittleEndian64(tail);
+        k1 *= c1; k1 = YSCRotateLeft64(k1, 31); k1 *= c2; h1 ^= k1;
+    }
+
+    h1 ^= length;
+    h2 ^= length;
+    h1 += h2;
+    h2 += h1;
+    h1 = YSCFinalMix64(h1);
+    h2 = YSCFinalMix64(h2);
+    h1 += h2;
+    h2 += h1;
+
+    YSCImageCacheKeyDigest digest = {h1, h2};
+    return digest;
+}
+
+#pragma mark - File names
+
+static const char kYSCHexDigits[16] = "0123456789abcdef";
+
+static inline void YSCWriteHexByte(char *buffer, uint8_t byte) {
+    buffer[0] = kYSCHexDigits[byte >> 4];
+    buffer[1] = kYSCHexDigits[byte & 0xf];
+}
+
+static NSString *YSCHexStringWithBytes(const uint8_t *bytes, size_t length) {
+    char buffer[2 * CC_MD5_DIGEST_LENGTH];
+    NSCParameterAssert(length <= CC_MD5_DIGEST_LENGTH);
+    for (size_t i = 0; i < length; i++) {
+        YSCWriteHexByte(buffer + 2 * i, bytes[i]);
+    }
+    return [[NSString alloc] initWithBytes:buffer length:2 * length encoding:NSASCIIStringEncoding];
+}
+
+@implementation YSCImageCacheKey {
+    NSString *_extension;
+    NSString *_legacyFileName;
+    NSString *_legacyFileNameWithoutExtension;
+    YSCImageCacheKeyDigest _legacyDigest;
+}
+
++ (nonnull instancetype)keyWithString:(nullable NSString *)key {
+    return [[self alloc] initWithKey:key];
+}
+
+- (nonnull instancetype)initWithKey:(nullable NSString *)key {
+    if ((self = [super init])) {
+        _key = [key copy] ?: @"";
+        const char *str = _key.UTF8String ?: "";
+        _digest = YSCImageCacheKeyDigestMake(str, strlen(str));
+
+        uint8_t bytes[16];
+        for (int i = 0; i < 8; i++) {
+            bytes[i] = (uint8_t)(_digest.high >> (56 - 8 * i));
+            bytes[8 + i] = (uint8_t)(_digest.low >> (56 - 8 * i));
+        }
+        _fileNameWithoutExtension = YSCHexStringWithBytes(bytes, sizeof(bytes));
+
+        NSURL *keyURL = [NSURL URLWithString:_key];
+        _extension = keyURL ? keyURL.pathExtension : _key.pathExtension;
+        _fileName = [self fileNameWithHexDigest:_fileNameWithoutExtension];
+    }
+    return self;
+}
+
+- (nonnull NSString *)fileNameWithHexDigest:(nonnull NSString *)hexDigest {
+    if (_extension.length == 0) {
+        return hexDigest;
+    }
+    return [[hexDigest stringByAppendingString:@"."] stringByAppendingString:_extension];
+}
+
+- (nonnull NSString *)legacyFileName {
+    @synchronized (self) {
+        if (!_legacyFileName) {
+            const char *str = _key.UTF8String ?: "";
+            unsigned char r[CC_MD5_DIGEST_LENGTH];
+            CC_MD5(str, (CC_LONG)strlen(str), r);
+            // read big endian, the order of the hex digits
+            for (int i = 0; i < 8; i++) {
+                _legacyDigest.high = (_legacyDigest.high << 8) | r[i];
+                _legacyDigest.low = (_legacyDigest.low << 8) | r[8 + i];
+            }
+            _legacyFileNameWithoutExtension = YSCHexStringWithBytes(r, CC_MD5_DIGEST_LENGTH);
+            _legacyFileName = [self fileNameWithHexDigest:_legacyFileNameWithoutExtension];
+        }
+        return _legacyFileName;
+    }
+}
+
+- (YSCImageCacheKeyDigest)legacyDigest {
+    [self legacyFileName];
+    @synchronized (self) {
+        return _legacyDigest;
+    }
+}
+
+- (nonnull NSString *)legacyFileNameWithoutExtension {
+    [self legacyFileName];
+    @synchronized (self) {
+        return _legacyFileNameWithoutExtension;
+    }
+}
+
+@end
@@ -0,0 +1,123 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * The number of buckets of a latency histogram. Bucket 0 counts the latencies under 2 microseconds, bucket i the
+ * latencies from 2^i to 2^(i+1) microseconds, the last bucket everything above.
+ */
+#define YSC_IMAGE_CACHE_LATENCY_BUCKET_COUNT 24
+
+typedef struct YSCImageCacheLatencyHistogram {
+    /**
+     * The number of samples
+     */
+    uint64_t count;
+    /**
+     * The sum of the samples, in microseconds
+     */
+    uint64_t totalMicroseconds;
+    uint64_t buckets[YSC_IMAGE_CACHE_LATENCY_BUCKET_COUNT];
+} YSCImageCacheLatencyHistogram;
+
+/**
+ * A snapshot of the cache metrics, accumulated since the metrics were enabled or last reset.
+ */
+typedef struct YSCImageCacheMetrics {
+    /**
+     * The number of queries answered from memory, by the decoded images or the encoded data
+     */
+    uint64_t memoryHitCount;
+    uint64_t memoryMissCount;
+    /**
+     * The number of disk lookups that found the data, including the stores not written yet
+     */
+    uint64_t diskHitCount;
+    uint64_t diskMissCount;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    /**
+     * The number of images the memory cache evicted on its own to stay under its limits
+     */
+    uint64_t memoryEvictionCount;
+    /**
+     * The number of files removed by the disk cache cleanups, expired or over the size and count limits
+     */
+    uint64_t diskEvictionCount;
+    /**
+     * The number of blocks dispatched on the IO queues
+     */
+    uint64_t ioQueueDispatchCount;
+    /**
+     * The total time the dispatched blocks waited before starting to run, in microseconds
+     */
+    uint64_t ioQueueWaitMicroseconds;
+    /**
+     * The number of blocks queued or running on the IO queues right now
+     */
+    uint64_t ioQueueDepth;
+    /**
+     * From the query call to the delivery of its result, for the single key queries
+     */
+    YSCImageCacheLatencyHistogram queryLatency;
+    /**
+     * The time to write one image to disk
+     */
+    YSCImageCacheLatencyHistogram storeLatency;
+    /**
+     * The time of a whole disk cleanup
+     */
+    YSCImageCacheLatencyHistogram cleanupLatency;
+} YSCImageCacheMetrics;
+
+typedef NS_ENUM(NSUInteger, YSCImageCacheMetricsCounter) {
+    YSCImageCacheMetricsCounterMemoryHit,
+    YSCImageCacheMetricsCounterMemoryMiss,
+    YSCImageCacheMetricsCounterDiskHit,
+    YSCImageCacheMetricsCounterDiskMiss,
+    YSCImageCacheMetricsCounterBytesRead,
+    YSCImageCacheMetricsCounterBytesWritten,
+    YSCImageCacheMetricsCounterDiskEviction,
+    YSCImageCacheMetricsCounterCount
+};
+
+typedef NS_ENUM(NSUInteger, YSCImageCacheMetricsOperation) {
+    YSCImageCacheMetricsOperationQuery,
+    YSCImageCacheMetricsOperationStore,
+    YSCImageCacheMetricsOperationCleanup,
+    YSCImageCacheMetricsOperationCount
+};
+
+/**
+ * Lock free recorder of the cache metrics, all the methods are thread safe.
+ * Times are `mach_absolute_time()` values.
+ */
+@interface YSCImageCacheMetricsRecorder : NSObject
+
+- (void)addValue:(uint64_t)value toCounter:(YSCImageCacheMetricsCounter)counter;
+
+/**
+ * Record the latency of an operation started at `startTime`.
+ */
+- (void)recordOperation:(YSCImageCacheMetricsOperation)operation startTime:(uint64_t)startTime;
+
+/**
+ * Wrap a block about to be dispatched on an IO queue, so the queue depth and the wait are recorded.
+ */
+- (nonnull dispatch_block_t)measuredIOQueueBlock:(nonnull dispatch_block_t)block;
+
+/**
+ * Take a snapshot of the metrics. The memory eviction count is left to the caller.
+ *
+ * @param reset Whether to reset the counters and the histograms, the samples recorded meanwhile are never lost
+ */
+- (YSCImageCacheMetrics)snapshotByResetting:(BOOL)reset;
+
+@end
@@ -0,0 +1,105 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCacheMetrics.h"
+#import <stdatomic.h>
+#import <mach/mach_time.h>
+
+typedef struct YSCAtomicLatencyHistogram {
+    _Atomic(uint64_t) count;
+    _Atomic(uint64_t) totalMicroseconds;
+    _Atomic(uint64_t) buckets[YSC_IMAGE_CACHE_LATENCY_BUCKET_COUNT];
+} YSCAtomicLatencyHistogram;
+
+static inline uint64_t YSCReadCounter(_Atomic(uint64_t) *counter, BOOL reset) {
+    return reset ? atomic_exchange_explicit(counter, 0, memory_order_relaxed) : atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+static YSCImageCacheLatencyHistogram YSCReadHistogram(YSCAtomicLatencyHistogram *histogram, BOOL reset) {
+    YSCImageCacheLatencyHistogram snapshot;
+    snapshot.count = YSCReadCounter(&histogram->count, reset);
+    snapshot.totalMicroseconds = YSCReadCounter(&histogram->totalMicroseconds, reset);
+    for (NSUInteger i = 0; i < YSC_IMAGE_CACHE_LATENCY_BUCKET_COUNT; i++) {
+        snapshot.buckets[i] = YSCReadCounter(&histogram->buckets[i], reset);
+    }
+    return snapshot;
+}
+
+@implementation YSCImageCacheMetricsRecorder {
+    _Atomic(uint64_t) _counters[YSCImageCacheMetricsCounterCount];
+    YSCAtomicLatencyHistogram _histograms[YSCImageCacheMetricsOperationCount];
+    _Atomic(uint64_t) _ioQueueDispatchCount;
+    _Atomic(uint64_t) _ioQueueWaitMicroseconds;
+    // a gauge, never reset
+    _Atomic(int64_t) _ioQueueDepth;
+    mach_timebase_info_data_t _timebase;
+}
+
+- (nonnull instancetype)init {
+    if ((self = [super init])) {
+        // the ivars are zeroed, which is a valid initial state for the atomics
+        mach_timebase_info(&_timebase);
+    }
+    return self;
+}
+
+- (uint64_t)microsecondsSince:(uint64_t)startTime {
+    uint64_t elapsed = mach_absolute_time() - startTime;
+    return elapsed * _timebase.numer / _timebase.denom / NSEC_PER_USEC;
+}
+
+#pragma mark - Recording
+
+- (void)addValue:(uint64_t)value toCounter:(YSCImageCacheMetricsCounter)counter {
+    atomic_fetch_add_explicit(&_counters[counter], value, memory_order_relaxed);
+}
+
+- (void)recordOperation:(YSCImageCacheMetricsOperation)operation startTime:(uint64_t)startTime {
+    uint64_t microseconds = [self microsecondsSince:startTime];
+    // the index of the highest bit set, 0 and 1 both go to the first bucket
+    NSUInteger bucket = microseconds > 1 ? 63 - __builtin_clzll(microseconds) : 0;
+    bucket = MIN(bucket, YSC_IMAGE_CACHE_LATENCY_BUCKET_COUNT - 1);
+    YSCAtomicLatencyHistogram *histogram = &_histograms[operation];
+    atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->totalMicroseconds, microseconds, memory_order_relaxed);
+    atomic_fetch_add_explicit(&histogram->buckets[bucket], 1, memory_order_relaxed);
+}
+
+- (nonnull dispatch_block_t)measuredIOQueueBlock:(nonnull dispatch_block_t)block {
+    uint64_t dispatchTime = mach_absolute_time();
+    atomic_fetch_add_explicit(&_ioQueueDepth, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&_ioQueueDispatchCount, 1, memory_order_relaxed);
+    return ^{
+        atomic_fetch_add_explicit(&self->_ioQueueWaitMicroseconds, [self microsecondsSince:dispatchTime], memory_order_relaxed);
+        block();
+        atomic_fetch_sub_explicit(&self->_ioQueueDepth, 1, memory_order_relaxed);
+    };
+}
+
+#pragma mark - Snapshot
+
+- (YSCImageCacheMetrics)snapshotByResetting:(BOOL)reset {
+    YSCImageCacheMetrics metrics;
+    memset(&metrics, 0, sizeof(metrics));
+    metrics.memoryHitCount = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterMemoryHit], reset);
+    metrics.memoryMissCount = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterMemoryMiss], reset);
+    metrics.diskHitCount = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterDiskHit], reset);
+    metrics.diskMissCount = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterDiskMiss], reset);
+    metrics.bytesRead = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterBytesRead], reset);
+    metrics.bytesWritten = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterBytesWritten], reset);
+    metrics.diskEvictionCount = YSCReadCounter(&_counters[YSCImageCacheMetricsCounterDiskEviction], reset);
+    metrics.ioQueueDispatchCount = YSCReadCounter(&_ioQueueDispatchCount, reset);
+    metrics.ioQueueWaitMicroseconds = YSCReadCounter(&_ioQueueWaitMicroseconds, reset);
+    metrics.ioQueueDepth = (uint64_t)MAX(atomic_load_explicit(&_ioQueueDepth, memory_order_relaxed), 0);
+    metrics.queryLatency = YSCReadHistogram(&_histograms[YSCImageCacheMetricsOperationQuery], reset);
+    metrics.storeLatency = YSCReadHistogram(&_histograms[YSCImageCacheMetricsOperationStore], reset);
+    metrics.cleanupLatency = YSCReadHistogram(&_histograms[YSCImageCacheMetricsOperationCleanup], reset);
+    return metrics;
+}
+
+@end
@@ -0,0 +1,107 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * Log-structured disk storage used by YSCImageCache when `diskCacheLayout` is `YSCImageCacheDiskLayoutPackFile`.
+ *
+ * Image data is appended to large segment files instead of being written one file per key. An in-memory hash index
+ * maps each key to its record, it is rebuilt by scanning the segments the first time the storage is used.
+ * Removing or overwriting a key appends a tombstone, and segments that are mostly dead are compacted in the background.
+ * Reads return a view into a memory mapping of the segment, no copy is made, except for the records appended to the
+ * active segment since it was mapped, which are read with a single pread.
+ *
+ * All the methods are thread safe. The records are written outside the lock the reads take, and only published in
+ * the index once written, so the reads don't wait for the disk writes.
+ */
+@interface YSCImageCachePackStorage : NSObject
+
+/**
+ * The directory holding the segment files
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *directory;
+
+/**
+ * The size a segment can grow to before a new one is started, in bytes.
+ */
+@property (nonatomic, assign, readonly) NSUInteger segmentSize;
+
+/**
+ * Exclude the segment directory from iCloud backup when it gets created [defaults to YES]
+ */
+@property (nonatomic, assign) BOOL shouldDisableiCloud;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Init a new pack storage. Nothing is read from disk until the storage is first used.
+ *
+ * @param directory   The directory to keep the segment files in
+ * @param segmentSize The size a segment can grow to before a new one is started, in bytes
+ */
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory segmentSize:(NSUInteger)segmentSize NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Synchronously append the data for the key, replacing any previous data.
+ *
+ * @return YES if the data has been written
+ */
+- (BOOL)storeData:(nonnull NSData *)data forKey:(nonnull NSString *)key;
+
+/**
+ * Synchronously read the data for the key. The returned data references the segment mapping, if any.
+ */
+- (nullable NSData *)dataForKey:(nonnull NSString *)key;
+
+/**
+ * Check whether the key has data in the storage, without reading it.
+ */
+- (BOOL)containsDataForKey:(nonnull NSString *)key;
+
+/**
+ * Sort the keys in the order of their data in the segments, so reading them in that order reads the segments
+ * sequentially. The keys without data come last.
+ */
+- (nonnull NSArray<NSString *> *)keysSortedByLocation:(nonnull NSArray<NSString *> *)keys;
+
+/**
+ * Synchronously remove the data for the key.
+ */
+- (void)removeDataForKey:(nonnull NSString *)key;
+
+/**
+ * Synchronously remove all the segments.
+ */
+- (void)removeAllData;
+
+/**
+ * Remove the entries stored before the expiration date.
+ */
+- (void)removeExpiredDataWithExpirationDate:(nonnull NSDate *)expirationDate;
+
+/**
+ * Remove the least recently read entries until the storage fits in the size and the count,
+ * removing at most `limit` entries per call.
+ *
+ * @return YES if the storage still doesn't fit once `limit` entries have been removed
+ */
+- (BOOL)trimToSize:(NSUInteger)size count:(NSUInteger)count limit:(NSUInteger)limit;
+
+/**
+ * The total size of the live entries, in bytes.
+ */
+- (NSUInteger)totalSize;
+
+/**
+ * The number of live entries.
+ */
+- (NSUInteger)totalCount;
+
+@end
@@ -0,0 +1,682 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCachePackStorage.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <sys/uio.h>
+
+static NSString * const kYSCPackSegmentExtension = @"pack";
+static const uint32_t kYSCPackRecordMagic = 0x50435359; // "YSCP"
+static const uint32_t kYSCPackRecordFlagTombstone = 1 << 0;
+// A sealed segment is compacted once less than this fraction of its bytes are still referenced
+static const double kYSCPackCompactionLiveRatio = 0.5;
+
+// Every record is a header followed by the UTF-8 key and the image data
+typedef struct YSCPackRecordHeader {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t keyLength;
+    uint32_t dataLength;
+    double timestamp;
+} YSCPackRecordHeader;
+
+@interface YSCImageCachePackEntry : NSObject
+
+@property (assign, nonatomic) uint32_t segmentID;
+@property (assign, nonatomic) uint64_t recordOffset;
+@property (assign, nonatomic) uint64_t recordLength;
+@property (assign, nonatomic) uint64_t dataOffset;
+@property (assign, nonatomic) uint32_t dataLength;
+@property (assign, nonatomic) NSTimeInterval timestamp;
+// kept in memory only, starts at the store time on each launch
+@property (assign, nonatomic) NSTimeInterval accessTime;
+
+@end
+
+@implementation YSCImageCachePackEntry
+@end
+
+@interface YSCImageCachePackSegment : NSObject
+
+@property (assign, nonatomic) uint32_t segmentID;
+@property (copy, nonatomic, nonnull) NSString *path;
+@property (assign, nonatomic) uint64_t size;
+// bytes of the put records still referenced by the index
+@property (assign, nonatomic) uint64_t liveBytes;
+@property (strong, nonatomic, nullable) NSData *mappedData;
+
+@end
+
+@implementation YSCImageCachePackSegment
+@end
+
+@interface YSCImageCachePackStorage ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *directory;
+@property (nonatomic, assign, readwrite) NSUInteger segmentSize;
+@property (strong, nonatomic, nonnull) dispatch_queue_t compactionQueue;
+
+@end
+
+@implementation YSCImageCachePackStorage {
+    NSMutableDictionary<NSString *, YSCImageCachePackEntry *> *_index;
+    NSMutableDictionary<NSNumber *, YSCImageCachePackSegment *> *_segments;
+    YSCImageCachePackSegment *_activeSegment;
+    int _activeFileDescriptor;
+    uint64_t _totalDataSize;
+    BOOL _loaded;
+    BOOL _compactionScheduled;
+    // Least recently used first, consumed by the successive trim calls
+    NSArray<NSString *> *_trimCandidates;
+    NSUInteger _trimCandidatesPosition;
+    NSTimeInterval _trimCandidatesTime;
+    // Serializes the appends and the changes of the index. It's taken before the lock, and the lock, which the reads
+    // take, is never held during a write.
+    NSObject *_writeLock;
+}
+
+- (nonnull instancetype)initWithDirectory:(nonnull NSString *)directory segmentSize:(NSUInteger)segmentSize {
+    if ((self = [super init])) {
+        _directory = [directory copy];
+        _segmentSize = segmentSize;
+        _shouldDisableiCloud = YES;
+        _index = [NSMutableDictionary dictionary];
+        _segments = [NSMutableDictionary dictionary];
+        _activeFileDescriptor = -1;
+        _writeLock = [NSObject new];
+        _compactionQueue = dispatch_queue_create("com.hackemist.YSCImageCachePackStorage", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_compactionQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_activeFileDescriptor >= 0) {
+        close(_activeFileDescriptor);
+    }
+}
+
+#pragma mark - Loading
+
+- (NSString *)pathForSegmentID:(uint32_t)segmentID {
+    NSString *fileName = [NSString stringWithFormat:@"%08x.%@", segmentID, kYSCPackSegmentExtension];
+    return [self.directory stringByAppendingPathComponent:fileName];
+}
+
+// Must be called with the lock held
+- (void)loadIfNeeded {
+    if (_loaded) {
+        return;
+    }
+    _loaded = YES;
+
+    NSFileManager *fileManager = [NSFileManager new];
+    if (![fileManager fileExistsAtPath:self.directory]) {
+        [fileManager createDirectoryAtPath:self.directory withIntermediateDirectories:YES attributes:nil error:NULL];
+        if (self.shouldDisableiCloud) {
+            [[NSURL fileURLWithPath:self.directory isDirectory:YES] setResourceValue:@YES forKey:NSURLIsExcludedFromBackupKey error:nil];
+        }
+    }
+
+    NSMutableArray<NSNumber *> *segmentIDs = [NSMutableArray array];
+    for (NSString *fileName in [fileManager contentsOfDirectoryAtPath:self.directory error:nil]) {
+        if (![fileName.pathExtension isEqualToString:kYSCPackSegmentExtension]) {
+            continue;
+        }
+        unsigned int segmentID = 0;
+        if ([[NSScanner scannerWithString:fileName.stringByDeletingPathExtension] scanHexInt:&segmentID]) {
+            [segmentIDs addObject:@(segmentID)];
+        }
+    }
+    [segmentIDs sortUsingSelector:@selector(compare:)];
+
+    // Replay the segments oldest first so later records win
+    for (NSNumber *segmentID in segmentIDs) {
+        YSCImageCachePackSegment *segment = [YSCImageCachePackSegment new];
+        segment.segmentID = segmentID.unsignedIntValue;
+        segment.path = [self pathForSegmentID:segment.segmentID];
+        _segments[segmentID] = segment;
+        [self replaySegment:segment isLast:[segmentID isEqualToNumber:segmentIDs.lastObject]];
+    }
+
+    YSCImageCachePackSegment *lastSegment = _segments[segmentIDs.lastObject];
+    if (lastSegment && lastSegment.size < self.segmentSize) {
+        [self openActiveSegment:lastSegment];
+    }
+}
+
+// Must be called with the lock held
+- (void)replaySegment:(YSCImageCachePackSegment *)segment isLast:(BOOL)isLast {
+    NSData *mappedData = [NSData dataWithContentsOfFile:segment.path options:NSDataReadingMappedAlways error:nil];
+    const uint8_t *bytes = mappedData.bytes;
+    uint64_t length = mappedData.length;
+    uint64_t offset = 0;
+
+    while (offset + sizeof(YSCPackRecordHeader) <= length) {
+        YSCPackRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        uint64_t recordLength = sizeof(header) + (uint64_t)header.keyLength + header.dataLength;
+        if (header.magic != kYSCPackRecordMagic || offset + recordLength > length) {
+            break;
+        }
+        NSString *key = [[NSString alloc] initWithBytes:bytes + offset + sizeof(header) length:header.keyLength encoding:NSUTF8StringEncoding];
+        if (!key) {
+            break;
+        }
+
+        [self discardEntryForKey:key];
+        if (!(header.flags & kYSCPackRecordFlagTombstone)) {
+            YSCImageCachePackEntry *entry = [YSCImageCachePackEntry new];
+            entry.segmentID = segment.segmentID;
+            entry.recordOffset = offset;
+            entry.recordLength = recordLength;
+            entry.dataOffset = offset + sizeof(header) + header.keyLength;
+            entry.dataLength = header.dataLength;
+            entry.timestamp = header.timestamp;
+            entry.accessTime = header.timestamp;
+            [self insertEntry:entry forKey:key];
+        }
+        offset += recordLength;
+    }
+
+    segment.size = offset;
+    if (offset < length) {
+        // Drop the torn record left by an interrupted write. Only the last segment was being appended to,
+        // an older segment keeps its tail as dead bytes until it gets compacted.
+        if (isLast) {
+            mappedData = nil;
+            truncate(segment.path.fileSystemRepresentation, (off_t)offset);
+        } else {
+            segment.size = length;
+        }
+    }
+    segment.mappedData = mappedData;
+}
+
+// Must be called with the lock held, and the write lock once loaded
+- (BOOL)openActiveSegment:(YSCImageCachePackSegment *)segment {
+    int fd = open(segment.path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        return NO;
+    }
+    if (_activeFileDescriptor >= 0) {
+        close(_activeFileDescriptor);
+    }
+    _activeFileDescriptor = fd;
+    _activeSegment = segment;
+    return YES;
+}
+
+// Must be called with the write lock and the lock held
+- (BOOL)startNewSegment {
+    uint32_t segmentID = 0;
+    for (NSNumber *existingID in _segments) {
+        segmentID = MAX(segmentID, existingID.unsignedIntValue + 1);
+    }
+    YSCImageCachePackSegment *segment = [YSCImageCachePackSegment new];
+    segment.segmentID = segmentID;
+    segment.path = [self pathForSegmentID:segmentID];
+    if (![self openActiveSegment:segment]) {
+        return NO;
+    }
+    _segments[@(segmentID)] = segment;
+    return YES;
+}
+
+#pragma mark - Index
+
+// Must be called with the lock held
+- (void)insertEntry:(YSCImageCachePackEntry *)entry forKey:(NSString *)key {
+    _index[key] = entry;
+    _segments[@(entry.segmentID)].liveBytes += entry.recordLength;
+    _totalDataSize += entry.dataLength;
+}
+
+// Must be called with the lock held
+- (void)discardEntryForKey:(NSString *)key {
+    YSCImageCachePackEntry *entry = _index[key];
+    if (!entry) {
+        return;
+    }
+    _segments[@(entry.segmentID)].liveBytes -= entry.recordLength;
+    _totalDataSize -= entry.dataLength;
+    [_index removeObjectForKey:key];
+}
+
+#pragma mark - Writing
+
+// Must be called with the write lock held and without the lock, the record is written while the reads go on
+- (nullable YSCImageCachePackEntry *)appendRecordForKey:(NSString *)key
+                                                  bytes:(const void *)bytes
+                                                 length:(NSUInteger)length
+                                                  flags:(uint32_t)flags
+                                              timestamp:(NSTimeInterval)timestamp {
+    NSData *keyData = [key dataUsingEncoding:NSUTF8StringEncoding];
+    if (!keyData || keyData.length > UINT32_MAX || length > UINT32_MAX) {
+        return nil;
+    }
+
+    YSCPackRecordHeader header;
+    header.magic = kYSCPackRecordMagic;
+    header.flags = flags;
+    header.keyLength = (uint32_t)keyData.length;
+    header.dataLength = (uint32_t)length;
+    header.timestamp = timestamp;
+    uint64_t recordLength = sizeof(header) + keyData.length + length;
+
+    // The active segment only changes with the write lock held, the lock is only needed to publish the changes
+    if (!_activeSegment || (_activeSegment.size > 0 && _activeSegment.size + recordLength > self.segmentSize)) {
+        @synchronized (self) {
+            if (![self startNewSegment]) {
+                return nil;
+            }
+        }
+    }
+    YSCImageCachePackSegment *segment = _activeSegment;
+    uint64_t recordOffset = segment.size;
+
+    struct iovec iov[3] = {
+        { .iov_base = &header, .iov_len = sizeof(header) },
+        { .iov_base = (void *)keyData.bytes, .iov_len = keyData.length },
+        { .iov_base = (void *)bytes, .iov_len = length },
+    };
+    ssize_t written = writev(_activeFileDescriptor, iov, length > 0 ? 3 : 2);
+    if (written != (ssize_t)recordLength) {
+        // Never leave a torn record in the middle of the segment
+        ftruncate(_activeFileDescriptor, (off_t)recordOffset);
+        return nil;
+    }
+
+    YSCImageCachePackEntry *entry = [YSCImageCachePackEntry new];
+    entry.segmentID = segment.segmentID;
+    entry.recordOffset = recordOffset;
+    entry.recordLength = recordLength;
+    entry.dataOffset = recordOffset + sizeof(header) + keyData.length;
+    entry.dataLength = (uint32_t)length;
+    entry.timestamp = timestamp;
+    entry.accessTime = [[NSDate date] timeIntervalSince1970];
+    @synchronized (self) {
+        segment.size = recordOffset + recordLength;
+    }
+    return entry;
+}
+
+- (BOOL)storeData:(nonnull NSData *)data forKey:(nonnull NSString *)key {
+    @synchronized (_writeLock) {
+        @synchronized (self) {
+            [self loadIfNeeded];
+        }
+        YSCImageCachePackEntry *entry = [self appendRecordForKey:key bytes:data.bytes length:data.length flags:0 timestamp:[[NSDate date] timeIntervalSince1970]];
+        if (!entry) {
+            return NO;
+        }
+        // Published once written, the reads never see a record being written
+        @synchronized (self) {
+            [self discardEntryForKey:key];
+            [self insertEntry:entry forKey:key];
+            [self scheduleCompactionIfNeeded];
+        }
+        return YES;
+    }
+}
+
+#pragma mark - Reading
+
+- (nullable NSData *)dataForKey:(nonnull NSString *)key {
+    NSData *mappedData = nil;
+    YSCImageCachePackEntry *entry = nil;
+    YSCImageCachePackSegment *segment = nil;
+    BOOL isActiveSegment = NO;
+    @synchronized (self) {
+        [self loadIfNeeded];
+        entry = _index[key];
+        if (!entry) {
+            return nil;
+        }
+        entry.accessTime = [[NSDate date] timeIntervalSince1970];
+        segment = _segments[@(entry.segmentID)];
+        mappedData = segment.mappedData;
+        isActiveSegment = segment == _activeSegment;
+    }
+
+    if (mappedData.length < entry.dataOffset + entry.dataLength) {
+        if (isActiveSegment) {
+            // Appended since the segment was mapped, the record is read rather than remapping the segment for every store
+            return [self readDataOfEntry:entry inSegmentAtPath:segment.path];
+        }
+        // A sealed segment doesn't change anymore, it's mapped once, without holding the lock
+        mappedData = [NSData dataWithContentsOfFile:segment.path options:NSDataReadingMappedAlways error:nil];
+        if (mappedData.length < entry.dataOffset + entry.dataLength) {
+            return nil;
+        }
+        @synchronized (self) {
+            if (segment.mappedData.length < mappedData.length) {
+                segment.mappedData = mappedData;
+            }
+        }
+    }
+
+    // The returned data keeps the mapping alive, even if the segment gets compacted and unlinked meanwhile
+    void *bytes = (uint8_t *)mappedData.bytes + entry.dataOffset;
+    return [[NSData alloc] initWithBytesNoCopy:bytes length:entry.dataLength deallocator:^(void *bytes, NSUInteger length) {
+        (void)mappedData;
+    }];
+}
+
+- (nullable NSData *)readDataOfEntry:(nonnull YSCImageCachePackEntry *)entry inSegmentAtPath:(nonnull NSString *)path {
+    int fd = open(path.fileSystemRepresentation, O_RDONLY);
+    if (fd < 0) {
+        return nil;
+    }
+    void *bytes = malloc(MAX(entry.dataLength, 1));
+    ssize_t readLength = bytes ? pread(fd, bytes, entry.dataLength, (off_t)entry.dataOffset) : -1;
+    close(fd);
+    if (readLength != (ssize_t)entry.dataLength) {
+        free(bytes);
+        return nil;
+    }
+    return [NSData dataWithBytesNoCopy:bytes length:entry.dataLength freeWhenDone:YES];
+}
+
+- (BOOL)containsDataForKey:(nonnull NSString *)key {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _index[key] != nil;
+    }
+}
+
+- (nonnull NSArray<NSString *> *)keysSortedByLocation:(nonnull NSArray<NSString *> *)keys {
+    NSMutableDictionary<NSString *, YSCImageCachePackEntry *> *entries = [NSMutableDictionary dictionaryWithCapacity:keys.count];
+    @synchronized (self) {
+        [self loadIfNeeded];
+        for (NSString *key in keys) {
+            entries[key] = _index[key];
+        }
+    }
+    return [keys sortedArrayUsingComparator:^NSComparisonResult(NSString *key1, NSString *key2) {
+        YSCImageCachePackEntry *packEntry1 = entries[key1];
+        YSCImageCachePackEntry *packEntry2 = entries[key2];
+        if (!packEntry1 || !packEntry2) {
+            return packEntry1 == packEntry2 ? NSOrderedSame : (packEntry1 ? NSOrderedAscending : NSOrderedDescending);
+        }
+        if (packEntry1.segmentID != packEntry2.segmentID) {
+            return packEntry1.segmentID < packEntry2.segmentID ? NSOrderedAscending : NSOrderedDescending;
+        }
+        if (packEntry1.dataOffset != packEntry2.dataOffset) {
+            return packEntry1.dataOffset < packEntry2.dataOffset ? NSOrderedAscending : NSOrderedDescending;
+        }
+        return NSOrderedSame;
+    }];
+}
+
+#pragma mark - Removing
+
+// Must be called with the write lock held and without the lock
+- (void)appendTombstoneForKey:(NSString *)key {
+    @synchronized (self) {
+        if (!_index[key]) {
+            return;
+        }
+    }
+    // If the tombstone can't be written, the data is dropped from the index anyway and will come back on next launch
+    [self appendRecordForKey:key bytes:NULL length:0 flags:kYSCPackRecordFlagTombstone timestamp:[[NSDate date] timeIntervalSince1970]];
+    @synchronized (self) {
+        [self discardEntryForKey:key];
+    }
+}
+
+- (void)removeDataForKey:(nonnull NSString *)key {
+    @synchronized (_writeLock) {
+        @synchronized (self) {
+            [self loadIfNeeded];
+        }
+        [self appendTombstoneForKey:key];
+        @synchronized (self) {
+            [self scheduleCompactionIfNeeded];
+        }
+    }
+}
+
+- (void)removeAllData {
+    @synchronized (_writeLock) {
+        @synchronized (self) {
+            if (_activeFileDescriptor >= 0) {
+                close(_activeFileDescriptor);
+                _activeFileDescriptor = -1;
+            }
+            _activeSegment = nil;
+            _trimCandidates = nil;
+            [_index removeAllObjects];
+            [_segments removeAllObjects];
+            _totalDataSize = 0;
+            _loaded = NO;
+            [[NSFileManager new] removeItemAtPath:self.directory error:nil];
+        }
+    }
+}
+
+- (void)removeExpiredDataWithExpirationDate:(nonnull NSDate *)expirationDate {
+    @synchronized (_writeLock) {
+        NSTimeInterval expirationTimestamp = expirationDate.timeIntervalSince1970;
+        NSMutableArray<NSString *> *expiredKeys = [NSMutableArray array];
+        @synchronized (self) {
+            [self loadIfNeeded];
+            [_index enumerateKeysAndObjectsUsingBlock:^(NSString *key, YSCImageCachePackEntry *entry, BOOL *stop) {
+                if (entry.timestamp < expirationTimestamp) {
+                    [expiredKeys addObject:key];
+                }
+            }];
+        }
+        for (NSString *key in expiredKeys) {
+            [self appendTombstoneForKey:key];
+        }
+
+        @synchronized (self) {
+            [self scheduleCompactionIfNeeded];
+        }
+    }
+}
+
+- (BOOL)trimToSize:(NSUInteger)size count:(NSUInteger)count limit:(NSUInteger)limit {
+    @synchronized (_writeLock) {
+        NSUInteger removedCount = 0;
+        BOOL sorted = NO;
+        BOOL limitReached = NO;
+
+        for (;;) {
+            // The next key to remove, picked with the lock held and removed without
+            NSString *key = nil;
+            @synchronized (self) {
+                [self loadIfNeeded];
+                while (!key && (_totalDataSize > size || _index.count > count)) {
+                    if (removedCount >= limit) {
+                        limitReached = YES;
+                        break;
+                    }
+                    if (_trimCandidatesPosition >= _trimCandidates.count) {
+                        if (sorted) {
+                            break;
+                        }
+                        // Sorting is the expensive part, so it's done once for all the steps of a trim
+                        _trimCandidates = [_index keysSortedByValueUsingComparator:^NSComparisonResult(YSCImageCachePackEntry *entry1, YSCImageCachePackEntry *entry2) {
+                            return [@(entry1.accessTime) compare:@(entry2.accessTime)];
+                        }];
+                        _trimCandidatesPosition = 0;
+                        _trimCandidatesTime = [[NSDate date] timeIntervalSince1970];
+                        sorted = YES;
+                        continue;
+                    }
+
+                    NSString *candidate = _trimCandidates[_trimCandidatesPosition++];
+                    YSCImageCachePackEntry *entry = _index[candidate];
+                    if (!entry || entry.accessTime > _trimCandidatesTime) {
+                        // removed, or read or stored again since the candidates were sorted
+                        continue;
+                    }
+                    key = candidate;
+                }
+                if (!key) {
+                    [self scheduleCompactionIfNeeded];
+                }
+            }
+            if (!key) {
+                return limitReached;
+            }
+            [self appendTombstoneForKey:key];
+            removedCount++;
+        }
+    }
+}
+
+#pragma mark - Compaction
+
+// Must be called with the lock held
+- (BOOL)shouldCompactSegment:(YSCImageCachePackSegment *)segment {
+    return segment != _activeSegment && segment.liveBytes < segment.size * kYSCPackCompactionLiveRatio;
+}
+
+// Must be called with the lock held
+- (void)scheduleCompactionIfNeeded {
+    if (_compactionScheduled) {
+        return;
+    }
+    for (YSCImageCachePackSegment *segment in _segments.allValues) {
+        if ([self shouldCompactSegment:segment]) {
+            _compactionScheduled = YES;
+            dispatch_async(self.compactionQueue, ^{
+                [self compact];
+            });
+            return;
+        }
+    }
+}
+
+- (void)compact {
+    NSArray<YSCImageCachePackSegment *> *segments = nil;
+    @synchronized (self) {
+        _compactionScheduled = NO;
+        NSMutableArray<YSCImageCachePackSegment *> *candidates = [NSMutableArray array];
+        for (YSCImageCachePackSegment *segment in _segments.allValues) {
+            if ([self shouldCompactSegment:segment]) {
+                [candidates addObject:segment];
+            }
+        }
+        segments = [candidates sortedArrayUsingComparator:^NSComparisonResult(YSCImageCachePackSegment *segment1, YSCImageCachePackSegment *segment2) {
+            return [@(segment1.segmentID) compare:@(segment2.segmentID)];
+        }];
+    }
+
+    for (YSCImageCachePackSegment *segment in segments) {
+        @autoreleasepool {
+            [self compactSegment:segment];
+        }
+    }
+}
+
+- (void)compactSegment:(YSCImageCachePackSegment *)segment {
+    // Sealed segments are never written again, so the mapping can be walked without holding the lock. A segment that
+    // was active when it was mapped, at load for example, grew since and is mapped again.
+    NSData *mappedData = nil;
+    @synchronized (self) {
+        mappedData = segment.mappedData;
+    }
+    if (mappedData.length < segment.size) {
+        mappedData = [NSData dataWithContentsOfFile:segment.path options:NSDataReadingMappedAlways error:nil];
+        @synchronized (self) {
+            if (segment.mappedData.length < mappedData.length) {
+                segment.mappedData = mappedData;
+            }
+        }
+    }
+    const uint8_t *bytes = mappedData.bytes;
+    uint64_t length = MIN((uint64_t)mappedData.length, segment.size);
+    uint64_t offset = 0;
+
+    while (offset + sizeof(YSCPackRecordHeader) <= length) {
+        YSCPackRecordHeader header;
+        memcpy(&header, bytes + offset, sizeof(header));
+        uint64_t recordLength = sizeof(header) + (uint64_t)header.keyLength + header.dataLength;
+        if (header.magic != kYSCPackRecordMagic || offset + recordLength > length) {
+            break;
+        }
+        NSString *key = [[NSString alloc] initWithBytes:bytes + offset + sizeof(header) length:header.keyLength encoding:NSUTF8StringEncoding];
+        if (key) {
+            // The records are moved one at a time, the reads and the stores go on in between
+            @synchronized (_writeLock) {
+                BOOL isTombstone = (header.flags & kYSCPackRecordFlagTombstone) != 0;
+                BOOL shouldMove = NO;
+                YSCImageCachePackEntry *entry = nil;
+                @synchronized (self) {
+                    if (_segments[@(segment.segmentID)] != segment) {
+                        // the storage has been cleared meanwhile
+                        return;
+                    }
+                    entry = _index[key];
+                    if (isTombstone) {
+                        // An older segment may still hold data this tombstone hides, keep it alive unless the key was stored again
+                        shouldMove = !entry && [self hasSegmentOlderThan:segment];
+                    } else {
+                        shouldMove = entry.segmentID == segment.segmentID && entry.recordOffset == offset;
+                    }
+                }
+                if (shouldMove && isTombstone) {
+                    [self appendRecordForKey:key bytes:NULL length:0 flags:kYSCPackRecordFlagTombstone timestamp:header.timestamp];
+                } else if (shouldMove) {
+                    // the entry can't change meanwhile, it only does with the write lock held
+                    YSCImageCachePackEntry *movedEntry = [self appendRecordForKey:key bytes:bytes + entry.dataOffset length:entry.dataLength flags:0 timestamp:entry.timestamp];
+                    if (!movedEntry) {
+                        // Out of space, keep the segment
+                        return;
+                    }
+                    @synchronized (self) {
+                        movedEntry.accessTime = entry.accessTime;
+                        [self discardEntryForKey:key];
+                        [self insertEntry:movedEntry forKey:key];
+                    }
+                }
+            }
+        }
+        offset += recordLength;
+    }
+
+    @synchronized (self) {
+        if (_segments[@(segment.segmentID)] == segment && segment.liveBytes == 0) {
+            [_segments removeObjectForKey:@(segment.segmentID)];
+            unlink(segment.path.fileSystemRepresentation);
+        }
+    }
+}
+
+// Must be called with the lock held
+- (BOOL)hasSegmentOlderThan:(YSCImageCachePackSegment *)segment {
+    for (NSNumber *segmentID in _segments) {
+        if (segmentID.unsignedIntValue < segment.segmentID) {
+            return YES;
+        }
+    }
+    return NO;
+}
+
+#pragma mark - Info
+
+- (NSUInteger)totalSize {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return (NSUInteger)_totalDataSize;
+    }
+}
+
+- (NSUInteger)totalCount {
+    @synchronized (self) {
+        [self loadIfNeeded];
+        return _index.count;
+    }
+}
+
+@end
@@ -0,0 +1,74 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+typedef NS_ENUM(uint8_t, YSCImageCacheTraceOperation) {
+    YSCImageCacheTraceOperationQuery = 1,
+    YSCImageCacheTraceOperationStore = 2
+};
+
+/**
+ * Where a query found the image. Same values as `YSCImageCacheType`.
+ */
+typedef NS_ENUM(uint8_t, YSCImageCacheTraceTier) {
+    YSCImageCacheTraceTierNone = 0,
+    YSCImageCacheTraceTierDisk = 1,
+    YSCImageCacheTraceTierMemory = 2
+};
+
+/**
+ * Records the queries and the stores of a cache to a compact binary trace, replayed offline by
+ * Tools/YSCCacheReplay to compare the eviction policies and the limits on a real workload.
+ *
+ * The trace is a 16 byte header, the magic "YST1", the record size and 8 reserved bytes, followed by fixed size
+ * little endian records:
+ *
+ *     uint64_t timestamp   microseconds since 1970
+ *     uint64_t keyHash     the high half of the digest of the key, the key itself is never recorded
+ *     uint32_t size        the size of the data queried or stored, in bytes, the decoded size for an image stored
+ *                          without its data
+ *     uint32_t latency     from the call to the completion, in microseconds
+ *     uint8_t  operation   YSCImageCacheTraceOperation
+ *     uint8_t  tier        YSCImageCacheTraceTier, for the queries
+ *     uint8_t  reserved[6]
+ *
+ * The records are buffered in memory and appended to the file in the background. All the methods are thread safe.
+ */
+@interface YSCImageCacheTraceRecorder : NSObject
+
+/**
+ * The path of the trace file
+ */
+@property (nonatomic, copy, readonly, nonnull) NSString *path;
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * Create the trace file, replacing an existing one.
+ *
+ * @return nil if the file can't be created
+ */
+- (nullable instancetype)initWithPath:(nonnull NSString *)path NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Record an operation started at `startTime`, a `mach_absolute_time()` value.
+ */
+- (void)recordOperation:(YSCImageCacheTraceOperation)operation
+                    key:(nonnull NSString *)key
+                   size:(NSUInteger)size
+                   tier:(YSCImageCacheTraceTier)tier
+              startTime:(uint64_t)startTime;
+
+/**
+ * Write the buffered records and close the file. The records of the later calls are dropped.
+ */
+- (void)close;
+
+@end
@@ -0,0 +1,146 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCImageCacheTraceRecorder.h"
+#import "YSCImageCacheKey.h"
+#import <fcntl.h>
+#import <unistd.h>
+#import <pthread.h>
+#import <mach/mach_time.h>
+
+static const uint32_t kYSCTraceMagic = 0x31545359; // "YST1", bump the last digit when the record changes
+// Written once the buffer holds this many bytes
+static const NSUInteger kYSCTraceBufferSize = 64 * 1024;
+
+typedef struct YSCTraceHeader {
+    uint32_t magic;
+    uint32_t recordSize;
+    uint64_t reserved;
+} YSCTraceHeader;
+
+typedef struct YSCTraceRecord {
+    uint64_t timestamp;
+    uint64_t keyHash;
+    uint32_t size;
+    uint32_t latency;
+    uint8_t operation;
+    uint8_t tier;
+    uint8_t reserved[6];
+} YSCTraceRecord;
+
+@interface YSCImageCacheTraceRecorder ()
+
+@property (nonatomic, copy, readwrite, nonnull) NSString *path;
+
+@end
+
+@implementation YSCImageCacheTraceRecorder {
+    pthread_mutex_t _lock;
+    NSMutableData *_buffer;
+    // Writes the full buffers in order, off the calling threads
+    dispatch_queue_t _writeQueue;
+    int _fileDescriptor;
+    mach_timebase_info_data_t _timebase;
+}
+
+- (nullable instancetype)initWithPath:(nonnull NSString *)path {
+    if ((self = [super init])) {
+        _path = [path copy];
+        pthread_mutex_init(&_lock, NULL);
+        [[NSFileManager new] createDirectoryAtPath:path.stringByDeletingLastPathComponent withIntermediateDirectories:YES attributes:nil error:NULL];
+        _fileDescriptor = open(path.fileSystemRepresentation, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (_fileDescriptor < 0) {
+            return nil;
+        }
+        YSCTraceHeader header = {kYSCTraceMagic, sizeof(YSCTraceRecord), 0};
+        if (write(_fileDescriptor, &header, sizeof(header)) != sizeof(header)) {
+            close(_fileDescriptor);
+            _fileDescriptor = -1;
+            return nil;
+        }
+        _buffer = [NSMutableData dataWithCapacity:kYSCTraceBufferSize];
+        _writeQueue = dispatch_queue_create("com.hackemist.YSCImageCacheTraceRecorder", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_writeQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+        mach_timebase_info(&_timebase);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    if (_fileDescriptor >= 0) {
+        // the write queue retains self, so it's drained already
+        [self writeBuffer:_buffer];
+        close(_fileDescriptor);
+    }
+    pthread_mutex_destroy(&_lock);
+}
+
+- (void)recordOperation:(YSCImageCacheTraceOperation)operation
+                    key:(nonnull NSString *)key
+                   size:(NSUInteger)size
+                   tier:(YSCImageCacheTraceTier)tier
+              startTime:(uint64_t)startTime {
+    YSCTraceRecord record;
+    memset(&record, 0, sizeof(record));
+    record.timestamp = (uint64_t)(([[NSDate date] timeIntervalSince1970]) * USEC_PER_SEC);
+    const char *str = key.UTF8String ?: "";
+    record.keyHash = YSCImageCacheKeyDigestMake(str, strlen(str)).high;
+    record.size = (uint32_t)MIN(size, UINT32_MAX);
+    uint64_t latency = (mach_absolute_time() - startTime) * _timebase.numer / _timebase.denom / NSEC_PER_USEC;
+    record.latency = (uint32_t)MIN(latency, UINT32_MAX);
+    record.operation = operation;
+    record.tier = tier;
+
+    NSData *fullBuffer = nil;
+    pthread_mutex_lock(&_lock);
+    if (_buffer) {
+        [_buffer appendBytes:&record length:sizeof(record)];
+        if (_buffer.length >= kYSCTraceBufferSize) {
+            fullBuffer = _buffer;
+            _buffer = [NSMutableData dataWithCapacity:kYSCTraceBufferSize];
+        }
+    }
+    pthread_mutex_unlock(&_lock);
+
+    if (fullBuffer) {
+        dispatch_async(_writeQueue, ^{
+            [self writeBuffer:fullBuffer];
+        });
+    }
+}
+
+- (void)close {
+    NSData *lastBuffer = nil;
+    pthread_mutex_lock(&_lock);
+    lastBuffer = _buffer;
+    _buffer = nil;
+    pthread_mutex_unlock(&_lock);
+    if (!lastBuffer) {
+        return;
+    }
+    dispatch_async(_writeQueue, ^{
+        [self writeBuffer:lastBuffer];
+        close(self->_fileDescriptor);
+        self->_fileDescriptor = -1;
+    });
+}
+
+// Must be called from the write queue
+- (void)writeBuffer:(nullable NSData *)buffer {
+    if (_fileDescriptor < 0 || buffer.length == 0) {
+        return;
+    }
+    // A short write drops the end of the buffer, the trace stays made of whole records
+    size_t length = buffer.length - buffer.length % sizeof(YSCTraceRecord);
+    ssize_t written = write(_fileDescriptor, buffer.bytes, length);
+    if (written > 0 && written % sizeof(YSCTraceRecord) != 0) {
+        ftruncate(_fileDescriptor, lseek(_fileDescriptor, 0, SEEK_CUR) - written % sizeof(YSCTraceRecord));
+    }
+}
+
+@end
@@ -0,0 +1,139 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+typedef NS_ENUM(NSInteger, YSCMemoryCacheEvictionPolicy) {
+    /**
+     * Evict the least recently used objects first
+     */
+    YSCMemoryCacheEvictionPolicyLRU,
+    /**
+     * Greedy Dual Size Frequency: evict the objects with the lowest access count per cost first, aged by an inflation
+     * value so the objects that stopped being used go eventually. Many small objects are kept rather than a few large
+     * ones, and an object costing more than half of `totalCostLimit` is not admitted.
+     */
+    YSCMemoryCacheEvictionPolicyGDSF
+};
+
+/**
+ * In-memory cache used by YSCImageCache in place of NSCache, with a defined least recently used eviction order.
+ *
+ * The keys are spread across lock stripes, each one holding a hash map and a doubly linked list ordered by access.
+ * A lookup only locks the stripe of its key. When the cache goes over its limits, the least recently used object of
+ * the stripe with the oldest tail is evicted, which keeps the order close to a global LRU. With the GDSF policy,
+ * the lowest priority object among the least recently used ones of every stripe is evicted.
+ *
+ * All the methods are thread safe.
+ */
+@interface YSCMemoryCache : NSObject
+
+/**
+ * The name of the cache
+ */
+@property (nonatomic, copy, nullable) NSString *name;
+
+/**
+ * The maximum total cost of the objects in the cache. Defaults to 0, which means no limit.
+ */
+@property (assign) NSUInteger totalCostLimit;
+
+/**
+ * The maximum number of objects in the cache. Defaults to 0, which means no limit.
+ */
+@property (assign) NSUInteger countLimit;
+
+/**
+ * The eviction policy. Defaults to LRU.
+ */
+@property (assign) YSCMemoryCacheEvictionPolicy evictionPolicy;
+
+/**
+ * The total cost of the objects in the cache
+ */
+@property (assign, readonly) NSUInteger totalCost;
+
+/**
+ * The number of objects in the cache
+ */
+@property (assign, readonly) NSUInteger totalCount;
+
+/**
+ * The number of lookups that found an object, since the cache was created or the statistics were last reset
+ */
+@property (assign, readonly) uint64_t hitCount;
+
+/**
+ * The number of lookups that found nothing, since the cache was created or the statistics were last reset
+ */
+@property (assign, readonly) uint64_t missCount;
+
+/**
+ * The number of objects evicted to stay under the limits or by a trim, since the cache was created or the statistics
+ * were last reset
+ */
+@property (assign, readonly) uint64_t evictionCount;
+
+/**
+ * Returns the object for the key and marks it as the most recently used.
+ */
+- (nullable id)objectForKey:(nonnull id)key;
+
+/**
+ * Whether the cache holds an object for the key that hasn't expired, without counting a hit or a miss nor marking the key
+ * as used.
+ */
+- (BOOL)containsObjectForKey:(nonnull id)key;
+
+/**
+ * Set the object for the key with a cost of 0.
+ */
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key;
+
+/**
+ * Set the object for the key, evicting the least recently used objects if the cache goes over its limits.
+ * Passing a nil object removes the key.
+ */
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key cost:(NSUInteger)cost;
+
+/**
+ * Set the object for the key, with an expiration time in seconds since 1970. An expired object is removed by the next
+ * lookup of its key, which misses. 0 means the object doesn't expire.
+ */
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key cost:(NSUInteger)cost expirationTime:(NSTimeInterval)expirationTime;
+
+/**
+ * Remove the object for the key.
+ */
+- (void)removeObjectForKey:(nonnull id)key;
+
+/**
+ * Remove all the objects.
+ */
+- (void)removeAllObjects;
+
+/**
+ * Evict objects, following the eviction policy, until both the total cost and the count are at most `ratio` of their
+ * current values. A ratio of 0 removes everything.
+ */
+- (void)trimToRatio:(double)ratio;
+
+/**
+ * Enumerate the most recently used keys with their cost, most recent first.
+ *
+ * @param limit The maximum number of keys to enumerate
+ */
+- (void)enumerateMostRecentlyUsedKeysWithLimit:(NSUInteger)limit usingBlock:(nonnull void (^)(id _Nonnull key, NSUInteger cost))block;
+
+/**
+ * Reset the hit, miss and eviction counts to zero.
+ */
+- (void)resetStatistics;
+
+@end
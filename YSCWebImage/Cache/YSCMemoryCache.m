@@ -0,0 +1,415 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCMemoryCache.h"
+#import <pthread.h>
+#import <stdatomic.h>
+#import <mach/mach_time.h>
+#import <float.h>
+
+// Must be a power of 2
+#define YSC_MEMORY_CACHE_STRIPE_COUNT 16
+// The number of least recently used nodes of every stripe compared by the GDSF eviction
+#define YSC_MEMORY_CACHE_GDSF_SAMPLE_COUNT 8
+
+@interface YSCMemoryCacheNode : NSObject {
+    @package
+    __unsafe_unretained YSCMemoryCacheNode *_prev;
+    __unsafe_unretained YSCMemoryCacheNode *_next;
+    id _key;
+    id _object;
+    NSUInteger _cost;
+    uint64_t _accessTime;
+    NSTimeInterval _expirationTime;
+    // GDSF only
+    NSUInteger _frequency;
+    double _priority;
+}
+@end
+
+@implementation YSCMemoryCacheNode
+@end
+
+// The map retains the nodes, the list links don't
+typedef struct YSCMemoryCacheStripe {
+    pthread_mutex_t lock;
+    CFMutableDictionaryRef map;
+    __unsafe_unretained YSCMemoryCacheNode *head; // most recently used
+    __unsafe_unretained YSCMemoryCacheNode *tail; // least recently used
+    NSUInteger cost;
+    NSUInteger count;
+} YSCMemoryCacheStripe;
+
+static CFMutableDictionaryRef YSCMemoryCacheStripeMapCreate(void) {
+    return CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+}
+
+// The stripe lock must be held for all the list functions
+static void YSCMemoryCacheStripeUnlink(YSCMemoryCacheStripe *stripe, YSCMemoryCacheNode *node) {
+    if (node->_prev) {
+        node->_prev->_next = node->_next;
+    } else {
+        stripe->head = node->_next;
+    }
+    if (node->_next) {
+        node->_next->_prev = node->_prev;
+    } else {
+        stripe->tail = node->_prev;
+    }
+    node->_prev = nil;
+    node->_next = nil;
+}
+
+static void YSCMemoryCacheStripeInsertAtHead(YSCMemoryCacheStripe *stripe, YSCMemoryCacheNode *node) {
+    node->_prev = nil;
+    node->_next = stripe->head;
+    if (stripe->head) {
+        stripe->head->_prev = node;
+    }
+    stripe->head = node;
+    if (!stripe->tail) {
+        stripe->tail = node;
+    }
+}
+
+@implementation YSCMemoryCache {
+    YSCMemoryCacheStripe _stripes[YSC_MEMORY_CACHE_STRIPE_COUNT];
+    // Only one thread evicts at a time, the others move on since the cache is being trimmed anyway
+    pthread_mutex_t _trimLock;
+    _Atomic(NSUInteger) _totalCost;
+    _Atomic(NSUInteger) _totalCount;
+    _Atomic(uint64_t) _hitCount;
+    _Atomic(uint64_t) _missCount;
+    _Atomic(uint64_t) _evictionCount;
+    // The priority of the last object evicted by GDSF, added to the priorities so the old objects age out
+    _Atomic(double) _inflation;
+}
+
+- (nonnull instancetype)init {
+    if ((self = [super init])) {
+        for (NSUInteger i = 0; i < YSC_MEMORY_CACHE_STRIPE_COUNT; i++) {
+            pthread_mutex_init(&_stripes[i].lock, NULL);
+            _stripes[i].map = YSCMemoryCacheStripeMapCreate();
+        }
+        pthread_mutex_init(&_trimLock, NULL);
+    }
+    return self;
+}
+
+- (void)dealloc {
+    for (NSUInteger i = 0; i < YSC_MEMORY_CACHE_STRIPE_COUNT; i++) {
+        _stripes[i].head = nil;
+        _stripes[i].tail = nil;
+        CFRelease(_stripes[i].map);
+        pthread_mutex_destroy(&_stripes[i].lock);
+    }
+    pthread_mutex_destroy(&_trimLock);
+}
+
+- (YSCMemoryCacheStripe *)stripeForKey:(id)key {
+    // Spread the bits of the hash, NSString hashes of similar URLs are not well distributed in the low bits
+    uint64_t hash = (uint64_t)[key hash] * 0x9E3779B97F4A7C15ULL;
+    return &_stripes[(hash >> 32) & (YSC_MEMORY_CACHE_STRIPE_COUNT - 1)];
+}
+
+#pragma mark - Access
+
+- (nullable id)objectForKey:(nonnull id)key {
+    if (!key) {
+        return nil;
+    }
+    YSCMemoryCacheStripe *stripe = [self stripeForKey:key];
+    id object = nil;
+    YSCMemoryCacheNode *expiredNode = nil;
+    pthread_mutex_lock(&stripe->lock);
+    YSCMemoryCacheNode *node = (__bridge YSCMemoryCacheNode *)CFDictionaryGetValue(stripe->map, (__bridge const void *)key);
+    if (node && node->_expirationTime > 0 && node->_expirationTime <= CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970) {
+        // released outside of the lock
+        expiredNode = node;
+        [self removeNode:node fromStripe:stripe];
+        node = nil;
+    }
+    if (node) {
+        node->_accessTime = mach_absolute_time();
+        node->_frequency++;
+        [self updatePriorityOfNode:node];
+        if (stripe->head != node) {
+            YSCMemoryCacheStripeUnlink(stripe, node);
+            YSCMemoryCacheStripeInsertAtHead(stripe, node);
+        }
+        object = node->_object;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    expiredNode = nil;
+
+    if (object) {
+        atomic_fetch_add_explicit(&_hitCount, 1, memory_order_relaxed);
+    } else {
+        atomic_fetch_add_explicit(&_missCount, 1, memory_order_relaxed);
+    }
+    return object;
+}
+
+- (BOOL)containsObjectForKey:(nonnull id)key {
+    if (!key) {
+        return NO;
+    }
+    YSCMemoryCacheStripe *stripe = [self stripeForKey:key];
+    pthread_mutex_lock(&stripe->lock);
+    YSCMemoryCacheNode *node = (__bridge YSCMemoryCacheNode *)CFDictionaryGetValue(stripe->map, (__bridge const void *)key);
+    // an expired object is left for the next lookup to remove, as if it was already gone
+    BOOL contains = node && (node->_expirationTime <= 0 || node->_expirationTime > CFAbsoluteTimeGetCurrent() + kCFAbsoluteTimeIntervalSince1970);
+    pthread_mutex_unlock(&stripe->lock);
+    return contains;
+}
+
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key {
+    [self setObject:obj forKey:key cost:0];
+}
+
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key cost:(NSUInteger)cost {
+    [self setObject:obj forKey:key cost:cost expirationTime:0];
+}
+
+- (void)setObject:(nullable id)obj forKey:(nonnull id)key cost:(NSUInteger)cost expirationTime:(NSTimeInterval)expirationTime {
+    if (!key) {
+        return;
+    }
+    NSUInteger costLimit = self.totalCostLimit;
+    BOOL admitted = self.evictionPolicy != YSCMemoryCacheEvictionPolicyGDSF || costLimit == 0 || cost <= costLimit / 2;
+    if (!obj || !admitted) {
+        [self removeObjectForKey:key];
+        return;
+    }
+
+    YSCMemoryCacheStripe *stripe = [self stripeForKey:key];
+    // Released outside of the lock, deallocating a large bitmap can take a while
+    id replacedObject = nil;
+    pthread_mutex_lock(&stripe->lock);
+    YSCMemoryCacheNode *node = (__bridge YSCMemoryCacheNode *)CFDictionaryGetValue(stripe->map, (__bridge const void *)key);
+    if (node) {
+        replacedObject = node->_object;
+        stripe->cost = stripe->cost - node->_cost + cost;
+        atomic_fetch_sub_explicit(&_totalCost, node->_cost, memory_order_relaxed);
+        YSCMemoryCacheStripeUnlink(stripe, node);
+    } else {
+        node = [YSCMemoryCacheNode new];
+        node->_key = key;
+        node->_frequency = 1;
+        CFDictionarySetValue(stripe->map, (__bridge const void *)key, (__bridge const void *)node);
+        stripe->cost += cost;
+        stripe->count++;
+        atomic_fetch_add_explicit(&_totalCount, 1, memory_order_relaxed);
+    }
+    node->_object = obj;
+    node->_cost = cost;
+    node->_accessTime = mach_absolute_time();
+    node->_expirationTime = expirationTime;
+    [self updatePriorityOfNode:node];
+    YSCMemoryCacheStripeInsertAtHead(stripe, node);
+    atomic_fetch_add_explicit(&_totalCost, cost, memory_order_relaxed);
+    pthread_mutex_unlock(&stripe->lock);
+    replacedObject = nil;
+
+    [self trimToLimitsIfNeeded];
+}
+
+- (void)removeObjectForKey:(nonnull id)key {
+    if (!key) {
+        return;
+    }
+    YSCMemoryCacheStripe *stripe = [self stripeForKey:key];
+    YSCMemoryCacheNode *node = nil;
+    pthread_mutex_lock(&stripe->lock);
+    node = (__bridge YSCMemoryCacheNode *)CFDictionaryGetValue(stripe->map, (__bridge const void *)key);
+    if (node) {
+        [self removeNode:node fromStripe:stripe];
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    // `node` is the last owner now, the object is released here outside of the lock
+}
+
+// The stripe lock must be held. The caller must keep a strong reference to the node, the map releases it.
+- (void)removeNode:(YSCMemoryCacheNode *)node fromStripe:(YSCMemoryCacheStripe *)stripe {
+    YSCMemoryCacheStripeUnlink(stripe, node);
+    stripe->cost -= node->_cost;
+    stripe->count--;
+    atomic_fetch_sub_explicit(&_totalCost, node->_cost, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&_totalCount, 1, memory_order_relaxed);
+    CFDictionaryRemoveValue(stripe->map, (__bridge const void *)node->_key);
+}
+
+- (void)removeAllObjects {
+    for (NSUInteger i = 0; i < YSC_MEMORY_CACHE_STRIPE_COUNT; i++) {
+        YSCMemoryCacheStripe *stripe = &_stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        CFMutableDictionaryRef map = stripe->map;
+        stripe->map = YSCMemoryCacheStripeMapCreate();
+        stripe->head = nil;
+        stripe->tail = nil;
+        atomic_fetch_sub_explicit(&_totalCost, stripe->cost, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&_totalCount, stripe->count, memory_order_relaxed);
+        stripe->cost = 0;
+        stripe->count = 0;
+        pthread_mutex_unlock(&stripe->lock);
+        CFRelease(map);
+    }
+}
+
+#pragma mark - Trimming
+
+// The stripe lock must be held
+- (void)updatePriorityOfNode:(YSCMemoryCacheNode *)node {
+    // The cost of a miss is the same for every object, so the priority is the access count per cost unit
+    node->_priority = atomic_load_explicit(&_inflation, memory_order_relaxed) + (double)node->_frequency / MAX(node->_cost, 1);
+}
+
+// The stripe lock must be held
+static YSCMemoryCacheNode *YSCMemoryCacheStripeLowestPriorityNode(YSCMemoryCacheStripe *stripe) {
+    YSCMemoryCacheNode *lowestNode = nil;
+    NSUInteger count = 0;
+    for (YSCMemoryCacheNode *node = stripe->tail; node && count < YSC_MEMORY_CACHE_GDSF_SAMPLE_COUNT; node = node->_prev, count++) {
+        if (!lowestNode || node->_priority < lowestNode->_priority) {
+            lowestNode = node;
+        }
+    }
+    return lowestNode;
+}
+
+- (void)trimToLimitsIfNeeded {
+    NSUInteger costLimit = self.totalCostLimit > 0 ? self.totalCostLimit : NSUIntegerMax;
+    NSUInteger countLimit = self.countLimit > 0 ? self.countLimit : NSUIntegerMax;
+    if (self.totalCost <= costLimit && self.totalCount <= countLimit) {
+        return;
+    }
+    if (pthread_mutex_trylock(&_trimLock) != 0) {
+        return;
+    }
+    [self evictToCost:costLimit count:countLimit];
+    pthread_mutex_unlock(&_trimLock);
+}
+
+- (void)trimToRatio:(double)ratio {
+    if (ratio <= 0) {
+        [self removeAllObjects];
+        return;
+    }
+    if (ratio >= 1) {
+        return;
+    }
+    pthread_mutex_lock(&_trimLock);
+    [self evictToCost:(NSUInteger)(self.totalCost * ratio) count:(NSUInteger)(self.totalCount * ratio)];
+    pthread_mutex_unlock(&_trimLock);
+}
+
+// The trim lock must be held
+- (void)evictToCost:(NSUInteger)costLimit count:(NSUInteger)countLimit {
+    // Keep the evicted nodes alive until all the locks are released
+    NSMutableArray<YSCMemoryCacheNode *> *evictedNodes = [NSMutableArray array];
+    BOOL gdsf = self.evictionPolicy == YSCMemoryCacheEvictionPolicyGDSF;
+    while (self.totalCost > costLimit || self.totalCount > countLimit) {
+        // Evict from the stripe whose least recently used object is the oldest, or has the lowest priority
+        YSCMemoryCacheStripe *evictedStripe = NULL;
+        uint64_t oldestAccessTime = UINT64_MAX;
+        double lowestPriority = DBL_MAX;
+        for (NSUInteger i = 0; i < YSC_MEMORY_CACHE_STRIPE_COUNT; i++) {
+            YSCMemoryCacheStripe *stripe = &_stripes[i];
+            pthread_mutex_lock(&stripe->lock);
+            if (gdsf) {
+                YSCMemoryCacheNode *node = YSCMemoryCacheStripeLowestPriorityNode(stripe);
+                if (node && node->_priority < lowestPriority) {
+                    lowestPriority = node->_priority;
+                    evictedStripe = stripe;
+                }
+            } else if (stripe->tail && stripe->tail->_accessTime < oldestAccessTime) {
+                oldestAccessTime = stripe->tail->_accessTime;
+                evictedStripe = stripe;
+            }
+            pthread_mutex_unlock(&stripe->lock);
+        }
+        if (!evictedStripe) {
+            break;
+        }
+
+        pthread_mutex_lock(&evictedStripe->lock);
+        YSCMemoryCacheNode *node = gdsf ? YSCMemoryCacheStripeLowestPriorityNode(evictedStripe) : evictedStripe->tail;
+        if (node) {
+            if (gdsf) {
+                atomic_store_explicit(&_inflation, node->_priority, memory_order_relaxed);
+            }
+            [evictedNodes addObject:node];
+            [self removeNode:node fromStripe:evictedStripe];
+            atomic_fetch_add_explicit(&_evictionCount, 1, memory_order_relaxed);
+        }
+        pthread_mutex_unlock(&evictedStripe->lock);
+    }
+}
+
+#pragma mark - Enumeration
+
+- (void)enumerateMostRecentlyUsedKeysWithLimit:(NSUInteger)limit usingBlock:(nonnull void (^)(id _Nonnull key, NSUInteger cost))block {
+    if (limit == 0) {
+        return;
+    }
+    // Every stripe list is ordered, the global order is among the first `limit` nodes of each stripe
+    NSMutableArray<YSCMemoryCacheNode *> *candidates = [NSMutableArray array];
+    for (NSUInteger i = 0; i < YSC_MEMORY_CACHE_STRIPE_COUNT; i++) {
+        YSCMemoryCacheStripe *stripe = &_stripes[i];
+        pthread_mutex_lock(&stripe->lock);
+        NSUInteger count = 0;
+        for (YSCMemoryCacheNode *node = stripe->head; node && count < limit; node = node->_next, count++) {
+            // a snapshot, the node may change once the lock is released
+            YSCMemoryCacheNode *candidate = [YSCMemoryCacheNode new];
+            candidate->_key = node->_key;
+            candidate->_cost = node->_cost;
+            candidate->_accessTime = node->_accessTime;
+            [candidates addObject:candidate];
+        }
+        pthread_mutex_unlock(&stripe->lock);
+    }
+    [candidates sortUsingComparator:^NSComparisonResult(YSCMemoryCacheNode *node1, YSCMemoryCacheNode *node2) {
+        if (node1->_accessTime == node2->_accessTime) {
+            return NSOrderedSame;
+        }
+        return node1->_accessTime > node2->_accessTime ? NSOrderedAscending : NSOrderedDescending;
+    }];
+    NSUInteger count = MIN(limit, candidates.count);
+    for (NSUInteger i = 0; i < count; i++) {
+        block(candidates[i]->_key, candidates[i]->_cost);
+    }
+}
+
+#pragma mark - Info
+
+- (NSUInteger)totalCost {
+    return atomic_load_explicit(&_totalCost, memory_order_relaxed);
+}
+
+- (NSUInteger)totalCount {
+    return atomic_load_explicit(&_totalCount, memory_order_relaxed);
+}
+
+- (uint64_t)hitCount {
+    return atomic_load_explicit(&_hitCount, memory_order_relaxed);
+}
+
+- (uint64_t)missCount {
+    return atomic_load_explicit(&_missCount, memory_order_relaxed);
+}
+
+- (uint64_t)evictionCount {
+    return atomic_load_explicit(&_evictionCount, memory_order_relaxed);
+}
+
+- (void)resetStatistics {
+    atomic_store_explicit(&_hitCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_missCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&_evictionCount, 0, memory_order_relaxed);
+}
+
+@end
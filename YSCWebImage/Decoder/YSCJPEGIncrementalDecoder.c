@@ -0,0 +1,336 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#ifdef YSC_JPEG_TURBO
+
+#include "YSCJPEGIncrementalDecoder.h"
+#include <setjmp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <jpeglib.h>
+
+#ifndef JCS_ALPHA_EXTENSIONS
+#error "The incremental JPEG decoder needs libjpeg-turbo, for its RGBA output"
+#endif
+
+// The rows read by one call of libjpeg
+#define YSC_JPEG_ROW_BATCH 8
+
+typedef enum YSCJPEGDecoderState {
+    YSCJPEGDecoderStateHeader,
+    YSCJPEGDecoderStateStart,
+    // baseline, the rows are output as they're decoded
+    YSCJPEGDecoderStateRows,
+    // progressive, a pass is output when a scan completes
+    YSCJPEGDecoderStateScans,
+    YSCJPEGDecoderStateFinish,
+    // finished, unsupported or failed, libjpeg is released
+    YSCJPEGDecoderStateDone,
+} YSCJPEGDecoderState;
+
+typedef struct YSCJPEGErrorManager {
+    struct jpeg_error_mgr pub;
+    jmp_buf jump;
+} YSCJPEGErrorManager;
+
+struct YSCJPEGIncrementalDecoder {
+    struct jpeg_decompress_struct cinfo;
+    YSCJPEGErrorManager error;
+    struct jpeg_source_mgr source;
+    YSCJPEGDecoderState state;
+    // The status returned once done
+    YSCJPEGIncrementalStatus status;
+    // The bytes kept for libjpeg between the updates, it backs up to the last marker or MCU when it suspends
+    uint8_t *buffer;
+    size_t bufferCapacity;
+    // The bytes libjpeg skips beyond the ones received so far
+    size_t pendingSkip;
+    bool inputFinished;
+    uint8_t *canvas;
+    size_t bytesPerRow;
+    int width;
+    int height;
+    // The last scan rendered to the canvas
+    int outputScan;
+};
+
+static void YSCJPEGErrorExit(j_common_ptr cinfo) {
+    YSCJPEGErrorManager *error = (YSCJPEGErrorManager *)cinfo->err;
+    longjmp(error->jump, 1);
+}
+
+// The warnings about corrupt data are expected while the image is downloading, don't print them
+static void YSCJPEGOutputMessage(j_common_ptr cinfo) {
+}
+
+static void YSCJPEGInitSource(j_decompress_ptr cinfo) {
+}
+
+static boolean YSCJPEGFillInputBuffer(j_decompress_ptr cinfo) {
+    YSCJPEGIncrementalDecoder *decoder = (YSCJPEGIncrementalDecoder *)cinfo->client_data;
+    if (!decoder->inputFinished) {
+        // suspend until the next update
+        return FALSE;
+    }
+    // A truncated image ends like a complete one
+    static const JOCTET kEOI[2] = {0xFF, JPEG_EOI};
+    cinfo->src->next_input_byte = kEOI;
+    cinfo->src->bytes_in_buffer = sizeof(kEOI);
+    return TRUE;
+}
+
+// Can't suspend, the bytes not received yet are skipped by the next updates
+static void YSCJPEGSkipInputData(j_decompress_ptr cinfo, long count) {
+    YSCJPEGIncrementalDecoder *decoder = (YSCJPEGIncrementalDecoder *)cinfo->client_data;
+    if (count <= 0) {
+        return;
+    }
+    struct jpeg_source_mgr *source = cinfo->src;
+    if ((size_t)count <= source->bytes_in_buffer) {
+        source->next_input_byte += count;
+        source->bytes_in_buffer -= count;
+    } else {
+        decoder->pendingSkip += (size_t)count - source->bytes_in_buffer;
+        source->next_input_byte += source->bytes_in_buffer;
+        source->bytes_in_buffer = 0;
+    }
+}
+
+static void YSCJPEGTermSource(j_decompress_ptr cinfo) {
+}
+
+// Keeps the bytes libjpeg left unconsumed in the decoder buffer, they may point into the bytes of the caller
+static bool YSCJPEGKeepInput(YSCJPEGIncrementalDecoder *decoder) {
+    struct jpeg_source_mgr *source = &decoder->source;
+    size_t length = source->bytes_in_buffer;
+    if (length == 0) {
+        source->next_input_byte = decoder->buffer;
+        return true;
+    }
+    if (source->next_input_byte == decoder->buffer) {
+        return true;
+    }
+    if (source->next_input_byte > decoder->buffer && source->next_input_byte < decoder->buffer + decoder->bufferCapacity) {
+        memmove(decoder->buffer, source->next_input_byte, length);
+    } else {
+        if (length > decoder->bufferCapacity) {
+            uint8_t *buffer = realloc(decoder->buffer, length);
+            if (!buffer) {
+                return false;
+            }
+            decoder->buffer = buffer;
+            decoder->bufferCapacity = length;
+        }
+        memcpy(decoder->buffer, source->next_input_byte, length);
+    }
+    source->next_input_byte = decoder->buffer;
+    return true;
+}
+
+// Hands the new bytes to libjpeg, after the ones it left unconsumed. They're only copied if some are left.
+static bool YSCJPEGAppendInput(YSCJPEGIncrementalDecoder *decoder, const uint8_t *bytes, size_t length) {
+    struct jpeg_source_mgr *source = &decoder->source;
+    size_t keptLength = source->bytes_in_buffer;
+    if (keptLength == 0) {
+        source->next_input_byte = bytes;
+        source->bytes_in_buffer = length;
+        return true;
+    }
+    if (length == 0) {
+        return true;
+    }
+    // The kept bytes are at the start of the buffer
+    if (keptLength + length > decoder->bufferCapacity) {
+        size_t capacity = (keptLength + length) * 2;
+        uint8_t *buffer = realloc(decoder->buffer, capacity);
+        if (!buffer) {
+            return false;
+        }
+        decoder->buffer = buffer;
+        decoder->bufferCapacity = capacity;
+    }
+    memcpy(decoder->buffer + keptLength, bytes, length);
+    source->next_input_byte = decoder->buffer;
+    source->bytes_in_buffer = keptLength + length;
+    return true;
+}
+
+YSCJPEGIncrementalDecoder *YSCJPEGIncrementalDecoderCreate(void) {
+    YSCJPEGIncrementalDecoder *decoder = calloc(1, sizeof(YSCJPEGIncrementalDecoder));
+    if (!decoder) {
+        return NULL;
+    }
+    decoder->cinfo.err = jpeg_std_error(&decoder->error.pub);
+    decoder->error.pub.error_exit = YSCJPEGErrorExit;
+    decoder->error.pub.output_message = YSCJPEGOutputMessage;
+    if (setjmp(decoder->error.jump)) {
+        // out of memory
+        jpeg_destroy_decompress(&decoder->cinfo);
+        free(decoder);
+        return NULL;
+    }
+    jpeg_create_decompress(&decoder->cinfo);
+    decoder->cinfo.client_data = decoder;
+    decoder->source.init_source = YSCJPEGInitSource;
+    decoder->source.fill_input_buffer = YSCJPEGFillInputBuffer;
+    decoder->source.skip_input_data = YSCJPEGSkipInputData;
+    decoder->source.resync_to_restart = jpeg_resync_to_restart;
+    decoder->source.term_source = YSCJPEGTermSource;
+    decoder->cinfo.src = &decoder->source;
+    decoder->state = YSCJPEGDecoderStateHeader;
+    return decoder;
+}
+
+void YSCJPEGIncrementalDecoderDestroy(YSCJPEGIncrementalDecoder *decoder) {
+    if (!decoder) {
+        return;
+    }
+    if (decoder->state != YSCJPEGDecoderStateDone) {
+        jpeg_destroy_decompress(&decoder->cinfo);
+    }
+    free(decoder->buffer);
+    free(decoder->canvas);
+    free(decoder);
+}
+
+// Releases libjpeg and the input, the canvas is kept
+static YSCJPEGIncrementalStatus YSCJPEGDecoderEnd(YSCJPEGIncrementalDecoder *decoder, YSCJPEGIncrementalStatus status) {
+    jpeg_destroy_decompress(&decoder->cinfo);
+    free(decoder->buffer);
+    decoder->buffer = NULL;
+    decoder->bufferCapacity = 0;
+    decoder->state = YSCJPEGDecoderStateDone;
+    decoder->status = status;
+    return status;
+}
+
+// Returns false if libjpeg suspended, waiting for more bytes
+static bool YSCJPEGReadScanlines(YSCJPEGIncrementalDecoder *decoder) {
+    struct jpeg_decompress_struct *cinfo = &decoder->cinfo;
+    while (cinfo->output_scanline < cinfo->output_height) {
+        JSAMPROW rows[YSC_JPEG_ROW_BATCH];
+        JDIMENSION count = cinfo->output_height - cinfo->output_scanline;
+        if (count > YSC_JPEG_ROW_BATCH) {
+            count = YSC_JPEG_ROW_BATCH;
+        }
+        for (JDIMENSION i = 0; i < count; i++) {
+            rows[i] = decoder->canvas + (cinfo->output_scanline + i) * decoder->bytesPerRow;
+        }
+        if (jpeg_read_scanlines(cinfo, rows, count) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+YSCJPEGIncrementalStatus YSCJPEGIncrementalDecoderUpdate(YSCJPEGIncrementalDecoder *decoder,
+                                                         const uint8_t *bytes, size_t length, bool finished,
+                                                         int *changedTop, int *changedBottom) {
+    *changedTop = 0;
+    *changedBottom = 0;
+    if (decoder->state == YSCJPEGDecoderStateDone) {
+        return decoder->status;
+    }
+    struct jpeg_decompress_struct *cinfo = &decoder->cinfo;
+
+    size_t skippedLength = decoder->pendingSkip < length ? decoder->pendingSkip : length;
+    decoder->pendingSkip -= skippedLength;
+    if (!YSCJPEGAppendInput(decoder, bytes + skippedLength, length - skippedLength)) {
+        return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusError);
+    }
+    decoder->inputFinished = finished;
+
+    if (setjmp(decoder->error.jump)) {
+        return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusError);
+    }
+
+    if (decoder->state == YSCJPEGDecoderStateHeader) {
+        if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED) {
+            goto suspended;
+        }
+        if (cinfo->jpeg_color_space == JCS_CMYK || cinfo->jpeg_color_space == JCS_YCCK) {
+            return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusUnsupported);
+        }
+        cinfo->out_color_space = JCS_EXT_RGBA;
+        cinfo->buffered_image = jpeg_has_multiple_scans(cinfo);
+        decoder->state = YSCJPEGDecoderStateStart;
+    }
+
+    if (decoder->state == YSCJPEGDecoderStateStart) {
+        if (!jpeg_start_decompress(cinfo)) {
+            goto suspended;
+        }
+        decoder->width = (int)cinfo->output_width;
+        decoder->height = (int)cinfo->output_height;
+        decoder->bytesPerRow = (size_t)cinfo->output_width * 4;
+        // zeroed, the rows not decoded yet are transparent
+        decoder->canvas = calloc(cinfo->output_height, decoder->bytesPerRow);
+        if (!decoder->canvas) {
+            return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusError);
+        }
+        decoder->state = cinfo->buffered_image ? YSCJPEGDecoderStateScans : YSCJPEGDecoderStateRows;
+    }
+
+    if (decoder->state == YSCJPEGDecoderStateRows) {
+        *changedTop = (int)cinfo->output_scanline;
+        bool complete = YSCJPEGReadScanlines(decoder);
+        *changedBottom = (int)cinfo->output_scanline;
+        if (!complete) {
+            goto suspended;
+        }
+        decoder->state = YSCJPEGDecoderStateFinish;
+    }
+
+    if (decoder->state == YSCJPEGDecoderStateScans) {
+        int result;
+        do {
+            result = jpeg_consume_input(cinfo);
+        } while (result != JPEG_SUSPENDED && result != JPEG_REACHED_EOI);
+        bool inputComplete = jpeg_input_complete(cinfo);
+        int completedScan = inputComplete ? cinfo->input_scan_number : cinfo->input_scan_number - 1;
+        if (completedScan > decoder->outputScan) {
+            // Only the last completed scan is rendered, the ones received along with it are already in it. Its data
+            // is all there, so the output pass doesn't suspend.
+            if (!jpeg_start_output(cinfo, completedScan)
+                || !YSCJPEGReadScanlines(decoder)
+                || !jpeg_finish_output(cinfo)) {
+                return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusError);
+            }
+            decoder->outputScan = completedScan;
+            *changedTop = 0;
+            *changedBottom = decoder->height;
+        }
+        if (!inputComplete) {
+            goto suspended;
+        }
+        decoder->state = YSCJPEGDecoderStateFinish;
+    }
+
+    // Reads up to the end of the image, all the rows are already in the canvas
+    if (!jpeg_finish_decompress(cinfo)) {
+        goto suspended;
+    }
+    return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusFinished);
+
+suspended:
+    if (!YSCJPEGKeepInput(decoder)) {
+        return YSCJPEGDecoderEnd(decoder, YSCJPEGIncrementalStatusError);
+    }
+    return YSCJPEGIncrementalStatusSuspended;
+}
+
+const uint8_t *YSCJPEGIncrementalDecoderGetCanvas(YSCJPEGIncrementalDecoder *decoder,
+                                                  int *width, int *height, size_t *bytesPerRow) {
+    *width = decoder->width;
+    *height = decoder->height;
+    *bytesPerRow = decoder->bytesPerRow;
+    return decoder->canvas;
+}
+
+#endif
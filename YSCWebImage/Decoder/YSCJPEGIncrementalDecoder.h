@@ -0,0 +1,78 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+/*
+ * An incremental JPEG decoder on libjpeg-turbo. It keeps the decoder state between the updates, so every update
+ * only takes the bytes received since the previous one, and decodes them into one canvas kept for the whole image.
+ * Baseline images render the rows decoded since the previous update, progressive images render a pass when a scan
+ * completes. Plain C, so it builds and runs off Apple platforms.
+ */
+
+#ifdef YSC_JPEG_TURBO
+
+#ifndef YSCJPEGIncrementalDecoder_h
+#define YSCJPEGIncrementalDecoder_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct YSCJPEGIncrementalDecoder YSCJPEGIncrementalDecoder;
+
+typedef enum YSCJPEGIncrementalStatus {
+    // More bytes are needed, the canvas may have changed
+    YSCJPEGIncrementalStatusSuspended,
+    // The whole image is decoded
+    YSCJPEGIncrementalStatusFinished,
+    // The color space can't be converted to RGBA, like CMYK, leave the image to another decoder
+    YSCJPEGIncrementalStatusUnsupported,
+    // The data isn't a valid JPEG
+    YSCJPEGIncrementalStatusError,
+} YSCJPEGIncrementalStatus;
+
+/**
+ * Returns a new decoder, or NULL if it can't be allocated.
+ */
+YSCJPEGIncrementalDecoder *YSCJPEGIncrementalDecoderCreate(void);
+
+/**
+ * Releases the decoder and its canvas, does nothing with NULL.
+ */
+void YSCJPEGIncrementalDecoderDestroy(YSCJPEGIncrementalDecoder *decoder);
+
+/**
+ * Decodes as much as possible with the bytes appended to the image since the previous update.
+ *
+ * @param bytes The new bytes only, they're copied if the decoder needs them again
+ * @param finished Whether these are the last bytes, a truncated image is then ended as if it was complete
+ * @param changedTop The first row of the canvas this update changed
+ * @param changedBottom The row below the last one this update changed, equal to `changedTop` if none did
+ * @return The status of the decoder, once finished, unsupported or failed it ignores the next updates
+ */
+YSCJPEGIncrementalStatus YSCJPEGIncrementalDecoderUpdate(YSCJPEGIncrementalDecoder *decoder,
+                                                         const uint8_t *bytes, size_t length, bool finished,
+                                                         int *changedTop, int *changedBottom);
+
+/**
+ * Returns the canvas, premultiplied RGBA rows from the top, with the rows not decoded yet transparent. NULL until the
+ * header is decoded. The pointer stays valid until the decoder is destroyed.
+ */
+const uint8_t *YSCJPEGIncrementalDecoderGetCanvas(YSCJPEGIncrementalDecoder *decoder,
+                                                  int *width, int *height, size_t *bytesPerRow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* YSCJPEGIncrementalDecoder_h */
+
+#endif
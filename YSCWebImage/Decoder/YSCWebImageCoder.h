@@ -15,6 +15,11 @@
  */
 FOUNDATION_EXPORT NSString * _Nonnull const YSCWebImageCoderScaleDownLargeImagesKey;
 
+/**
+ The compression quality of lossy encodings, from 0 (smallest) to 1 (best). (NSNumber)
+ */
+FOUNDATION_EXPORT NSString * _Nonnull const YSCWebImageCoderEncodeCompressionQualityKey;
+
 /**
  Return the shared device-dependent RGB color space created with CGColorSpaceCreateDeviceRGB.
 
@@ -87,6 +92,19 @@ CG_EXTERN BOOL YSCCGImageRefContainsAlpha(_Nullable CGImageRef imageRef);
  */
 - (nullable NSData *)encodedDataWithImage:(nullable UIImage *)image format:(YSCImageFormat)format;
 
+@optional
+/**
+ Encode the image to image data with options.
+
+ @param image The image to be encoded
+ @param format The image format to encode, you should note `YSCImageFormatUndefined` format is also  possible
+ @param optionsDict A dictionary containing any encoding options. Pass {YSCWebImageCoderEncodeCompressionQualityKey: @(0.8)} to set the quality of lossy formats
+ @return The encoded image data
+ */
+- (nullable NSData *)encodedDataWithImage:(nullable UIImage *)image
+                                   format:(YSCImageFormat)format
+                                  options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict;
+
 @end
 
 
@@ -9,6 +9,7 @@
 #import "YSCWebImageCoder.h"
 
 NSString * const YSCWebImageCoderScaleDownLargeImagesKey = @"scaleDownLargeImages";
+NSString * const YSCWebImageCoderEncodeCompressionQualityKey = @"encodeCompressionQuality";
 
 CGColorSpaceRef YSCCGColorSpaceGetDeviceRGB(void) {
     static CGColorSpaceRef colorSpace;
@@ -12,6 +12,9 @@
 #ifdef YSC_WEBP
 #import "YSCWebImageWebPCoder.h"
 #endif
+#ifdef YSC_JPEG_TURBO
+#import "YSCWebImageJPEGCoder.h"
+#endif
 
 @interface YSCWebImageCodersManager ()
 
@@ -37,6 +40,10 @@
         _mutableCoders = [@[[YSCWebImageImageIOCoder sharedCoder]] mutableCopy];
 #ifdef YSC_WEBP
         [_mutableCoders addObject:[YSCWebImageWebPCoder sharedCoder]];
+#endif
+#ifdef YSC_JPEG_TURBO
+        // after ImageIO, so it's asked first for the progressive JPEG decoding
+        [_mutableCoders addObject:[YSCWebImageJPEGCoder sharedCoder]];
 #endif
         _mutableCodersAccessQueue = dispatch_queue_create("com.hackemist.YSCWebImageCodersManager", DISPATCH_QUEUE_CONCURRENT);
     }
@@ -119,11 +126,18 @@
 }
 
 - (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format {
+    return [self encodedDataWithImage:image format:format options:nil];
+}
+
+- (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
     if (!image) {
         return nil;
     }
     for (id<YSCWebImageCoder> coder in self.coders) {
         if ([coder canEncodeToFormat:format]) {
+            if (optionsDict && [coder respondsToSelector:@selector(encodedDataWithImage:format:options:)]) {
+                return [coder encodedDataWithImage:image format:format options:optionsDict];
+            }
             return [coder encodedDataWithImage:image format:format];
         }
     }
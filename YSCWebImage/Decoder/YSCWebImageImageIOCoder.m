@@ -46,6 +46,7 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
         UIImageOrientation _orientation;
 #endif
         CGImageSourceRef _imageSource;
+        NSUInteger _updatedLength;
 }
 
 - (void)dealloc {
@@ -126,7 +127,14 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     // The following code is from http://www.cocoaintheshell.com/2011/05/progressive-images-download-imageio/
     // Thanks to the author @Nyx0uf
     
-    // Update the data source, we must pass ALL the data, not just the new bytes
+    // Nothing new to decode
+    if (!finished && data.length <= _updatedLength) {
+        return nil;
+    }
+    _updatedLength = data.length;
+    
+    // Update the data source, we must pass ALL the data, not just the new bytes. The downloader hands a view of its
+    // buffer, so this doesn't copy them.
     CGImageSourceUpdateData(_imageSource, (__bridge CFDataRef)data, finished);
     
     if (_width + _height == 0) {
@@ -158,19 +166,9 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
 #if YSC_UIKIT || YSC_WATCH
         // Workaround for iOS anamorphic image
         if (partialImageRef) {
-            const size_t partialHeight = CGImageGetHeight(partialImageRef);
-            CGColorSpaceRef colorSpace = YSCCGColorSpaceGetDeviceRGB();
-            CGContextRef bmContext = CGBitmapContextCreate(NULL, _width, _height, 8, 0, colorSpace, kCGBitmapByteOrderDefault | kCGImageAlphaPremultipliedFirst);
-            if (bmContext) {
-                CGContextDrawImage(bmContext, (CGRect){.origin.x = 0.0f, .origin.y = 0.0f, .size.width = _width, .size.height = partialHeight}, partialImageRef);
-                CGImageRelease(partialImageRef);
-                partialImageRef = CGBitmapContextCreateImage(bmContext);
-                CGContextRelease(bmContext);
-            }
-            else {
-                CGImageRelease(partialImageRef);
-                partialImageRef = nil;
-            }
+            CGImageRef canvasImageRef = [self partialImageByDrawingImage:partialImageRef];
+            CGImageRelease(partialImageRef);
+            partialImageRef = canvasImageRef;
         }
 #endif
         
@@ -189,11 +187,31 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
             CFRelease(_imageSource);
             _imageSource = NULL;
         }
+        _updatedLength = 0;
     }
     
     return image;
 }
 
+#if YSC_UIKIT || YSC_WATCH
+// Draws a partial image into a new bitmap of the full size. ImageIO returns the partial images at full height, so a
+// canvas kept between the updates would be redrawn whole anyway, and copied on the next draw since the previous frame
+// is still displayed. The context is released before the next draw, so the returned image takes its memory over.
+- (nullable CGImageRef)partialImageByDrawingImage:(nonnull CGImageRef)partialImageRef CF_RETURNS_RETAINED {
+    CGColorSpaceRef colorSpace = YSCCGColorSpaceGetDeviceRGB();
+    CGContextRef context = CGBitmapContextCreate(NULL, _width, _height, 8, 0, colorSpace, kCGBitmapByteOrderDefault | kCGImageAlphaPremultipliedFirst);
+    if (!context) {
+        return NULL;
+    }
+    const size_t partialHeight = MIN(CGImageGetHeight(partialImageRef), _height);
+    // The image is drawn from the top, the Core Graphics origin is at the bottom
+    CGContextDrawImage(context, CGRectMake(0, _height - partialHeight, _width, partialHeight), partialImageRef);
+    CGImageRef imageRef = CGBitmapContextCreateImage(context);
+    CGContextRelease(context);
+    return imageRef;
+}
+#endif
+
 - (UIImage *)decompressedImageWithImage:(UIImage *)image
                                    data:(NSData *__autoreleasing  _Nullable *)data
                                 options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
@@ -404,6 +422,10 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
 }
 
 - (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format {
+    return [self encodedDataWithImage:image format:format options:nil];
+}
+
+- (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
     if (!image) {
         return nil;
     }
@@ -432,6 +454,11 @@ static const CGFloat kDestSeemOverlap = 2.0f;   // the numbers of pixels to over
     NSInteger exifOrientation = [YSCWebImageCoderHelper exifOrientationFromImageOrientation:image.imageOrientation];
     [properties setValue:@(exifOrientation) forKey:(__bridge_transfer NSString *)kCGImagePropertyOrientation];
 #endif
+    NSNumber *compressionQuality = (NSNumber *)optionsDict[YSCWebImageCoderEncodeCompressionQualityKey];
+    if ([compressionQuality isKindOfClass:[NSNumber class]]) {
+        // ignored by the lossless formats
+        properties[(__bridge NSString *)kCGImageDestinationLossyCompressionQuality] = compressionQuality;
+    }
     
     // Add your image to the destination.
     CGImageDestinationAddImage(imageDestination, image.CGImage, (__bridge CFDictionaryRef)properties);
@@ -0,0 +1,30 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#ifdef YSC_JPEG_TURBO
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCoder.h"
+
+/**
+ Progressive JPEG decoding on libjpeg-turbo, built with `YSC_JPEG_TURBO`.
+
+ Unlike `YSCWebImageImageIOCoder`, which decodes all the data received so far on every update, it keeps the decoder
+ state between the updates and only decodes the new bytes. Baseline images render the rows decoded since the previous
+ update, progressive images a pass per completed scan. CMYK images get no partial images.
+
+ The complete image is still decoded by `YSCWebImageImageIOCoder`, which this coder defers to for everything but the
+ progressive decoding.
+ */
+@interface YSCWebImageJPEGCoder : NSObject <YSCWebImageProgressiveCoder>
+
++ (nonnull instancetype)sharedCoder;
+
+@end
+
+#endif
@@ -0,0 +1,274 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#ifdef YSC_JPEG_TURBO
+
+#import "YSCWebImageJPEGCoder.h"
+#import "YSCWebImageImageIOCoder.h"
+#import "YSCWebImageCoderHelper.h"
+#import "NSData+YSCImageContentType.h"
+#import "YSCJPEGIncrementalDecoder.h"
+#import <ImageIO/ImageIO.h>
+#import <stdatomic.h>
+
+/**
+ * The pixels of a partial image, shared with the partial images published from it. The canvas isn't written to while
+ * one of them is still alive.
+ */
+@interface YSCJPEGProgressiveCanvas : NSObject {
+    @public
+    uint8_t *_bytes;
+    size_t _bytesPerRow;
+    int _width;
+    int _height;
+    // The rows the decoder changed since they were copied to the canvas
+    int _dirtyTop;
+    int _dirtyBottom;
+    _Atomic(NSUInteger) _imageCount;
+}
+
+@end
+
+@implementation YSCJPEGProgressiveCanvas
+
+- (void)dealloc {
+    free(_bytes);
+}
+
+@end
+
+// Called when a partial image is released, balances the retain in `partialImageFromCanvas:`
+static void YSCJPEGProgressiveCanvasReleaseImageData(void *info, const void *data, size_t size) {
+    YSCJPEGProgressiveCanvas *canvas = (__bridge_transfer YSCJPEGProgressiveCanvas *)info;
+    atomic_fetch_sub_explicit(&canvas->_imageCount, 1, memory_order_release);
+}
+
+static void YSCJPEGProgressiveCanvasMarkRows(YSCJPEGProgressiveCanvas * _Nullable canvas, int top, int bottom) {
+    if (!canvas) {
+        return;
+    }
+    if (canvas->_dirtyBottom <= canvas->_dirtyTop) {
+        canvas->_dirtyTop = top;
+        canvas->_dirtyBottom = bottom;
+    } else {
+        canvas->_dirtyTop = MIN(canvas->_dirtyTop, top);
+        canvas->_dirtyBottom = MAX(canvas->_dirtyBottom, bottom);
+    }
+}
+
+// Whether the next rows can be written to the canvas, none of its partial images is alive anymore
+static BOOL YSCJPEGProgressiveCanvasIsWritable(YSCJPEGProgressiveCanvas * _Nullable canvas, int width, int height) {
+    return canvas && canvas->_width == width && canvas->_height == height
+        && atomic_load_explicit(&canvas->_imageCount, memory_order_acquire) == 0;
+}
+
+@implementation YSCWebImageJPEGCoder {
+    YSCJPEGIncrementalDecoder *_decoder;
+    // The length of the data handed to the decoder, the next update only hands the bytes after it
+    NSUInteger _decodedLength;
+    // The decoder finished, or gave up on the image, until the download finishes
+    BOOL _decodingEnded;
+    // The canvas of the last partial image, and the one before, which the updates alternate between
+    YSCJPEGProgressiveCanvas *_progressiveCanvas;
+    YSCJPEGProgressiveCanvas *_spareProgressiveCanvas;
+#if YSC_UIKIT || YSC_WATCH
+    UIImageOrientation _orientation;
+    BOOL _orientationRead;
+#endif
+}
+
+- (void)dealloc {
+    YSCJPEGIncrementalDecoderDestroy(_decoder);
+}
+
++ (instancetype)sharedCoder {
+    static YSCWebImageJPEGCoder *coder;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        coder = [[YSCWebImageJPEGCoder alloc] init];
+    });
+    return coder;
+}
+
+#pragma mark - Decode
+- (BOOL)canDecodeFromData:(nullable NSData *)data {
+    // ImageIO decodes the complete images, with their color profile
+    return NO;
+}
+
+- (BOOL)canIncrementallyDecodeFromData:(NSData *)data {
+    return ([NSData YSC_imageFormatForImageData:data] == YSCImageFormatJPEG);
+}
+
+- (UIImage *)decodedImageWithData:(NSData *)data {
+    return [[YSCWebImageImageIOCoder sharedCoder] decodedImageWithData:data];
+}
+
+- (UIImage *)incrementallyDecodedImageWithData:(NSData *)data finished:(BOOL)finished {
+    if (_decodingEnded) {
+        if (finished) {
+            _decodingEnded = NO;
+            _decodedLength = 0;
+        }
+        return nil;
+    }
+    if (!_decoder) {
+        _decoder = YSCJPEGIncrementalDecoderCreate();
+        if (!_decoder) {
+            return nil;
+        }
+    }
+    if (data.length < _decodedLength) {
+        // not the data of this download
+        return nil;
+    }
+
+    UIImage *image;
+
+    // Only the bytes received since the previous update are decoded, the decoder keeps its state in between
+    int changedTop = 0;
+    int changedBottom = 0;
+    YSCJPEGIncrementalStatus status = YSCJPEGIncrementalDecoderUpdate(_decoder, (const uint8_t *)data.bytes + _decodedLength, data.length - _decodedLength, finished, &changedTop, &changedBottom);
+    _decodedLength = data.length;
+
+    if (changedBottom > changedTop) {
+        int width = 0;
+        int height = 0;
+        size_t bytesPerRow = 0;
+        const uint8_t *pixels = YSCJPEGIncrementalDecoderGetCanvas(_decoder, &width, &height, &bytesPerRow);
+        YSCJPEGProgressiveCanvasMarkRows(_progressiveCanvas, changedTop, changedBottom);
+        YSCJPEGProgressiveCanvasMarkRows(_spareProgressiveCanvas, changedTop, changedBottom);
+        YSCJPEGProgressiveCanvas *canvas = [self progressiveCanvasWithWidth:width height:height];
+        if (!canvas) {
+            return nil;
+        }
+        // Only the rows the canvas misses are copied
+        for (int y = canvas->_dirtyTop; y < canvas->_dirtyBottom; y++) {
+            memcpy(canvas->_bytes + y * canvas->_bytesPerRow, pixels + y * bytesPerRow, canvas->_bytesPerRow);
+        }
+        canvas->_dirtyTop = canvas->_dirtyBottom = 0;
+
+        // The rows not decoded yet stay transparent
+        CGImageRef partialImageRef = [self partialImageFromCanvas:canvas];
+        if (partialImageRef) {
+#if YSC_UIKIT || YSC_WATCH
+            if (!_orientationRead) {
+                // The EXIF data comes before the image data, it's all there by now
+                _orientation = [self imageOrientationFromImageData:data];
+                _orientationRead = YES;
+            }
+            image = [UIImage imageWithCGImage:partialImageRef scale:1 orientation:_orientation];
+#elif YSC_MAC
+            image = [[UIImage alloc] initWithCGImage:partialImageRef size:NSZeroSize];
+#endif
+            CGImageRelease(partialImageRef);
+        }
+    }
+
+    if (finished || status != YSCJPEGIncrementalStatusSuspended) {
+        YSCJPEGIncrementalDecoderDestroy(_decoder);
+        _decoder = NULL;
+        _decodedLength = 0;
+        _decodingEnded = !finished;
+        // the partial images still alive keep them
+        _progressiveCanvas = nil;
+        _spareProgressiveCanvas = nil;
+    }
+
+    return image;
+}
+
+// Returns the canvas to write the changed rows to. The last partial image is usually still displayed when the next one
+// is decoded, but the one before has been replaced by then, so the updates alternate between two canvases. A canvas
+// is only allocated when both still have a partial image alive.
+- (nullable YSCJPEGProgressiveCanvas *)progressiveCanvasWithWidth:(int)width height:(int)height {
+    if (YSCJPEGProgressiveCanvasIsWritable(_progressiveCanvas, width, height)) {
+        return _progressiveCanvas;
+    }
+    if (YSCJPEGProgressiveCanvasIsWritable(_spareProgressiveCanvas, width, height)) {
+        YSCJPEGProgressiveCanvas *canvas = _spareProgressiveCanvas;
+        _spareProgressiveCanvas = _progressiveCanvas;
+        _progressiveCanvas = canvas;
+        return canvas;
+    }
+
+    YSCJPEGProgressiveCanvas *newCanvas = [YSCJPEGProgressiveCanvas new];
+    newCanvas->_width = width;
+    newCanvas->_height = height;
+    newCanvas->_bytesPerRow = (size_t)width * 4;
+    newCanvas->_bytes = malloc(height * newCanvas->_bytesPerRow);
+    if (!newCanvas->_bytes) {
+        return nil;
+    }
+    // the decoder canvas has the rows not decoded yet transparent
+    newCanvas->_dirtyTop = 0;
+    newCanvas->_dirtyBottom = height;
+    // a busy spare is kept alive by its partial images
+    _spareProgressiveCanvas = _progressiveCanvas;
+    _progressiveCanvas = newCanvas;
+    return newCanvas;
+}
+
+// The image reads the canvas memory without copying it, the canvas isn't written to again until the image is released
+- (nullable CGImageRef)partialImageFromCanvas:(nonnull YSCJPEGProgressiveCanvas *)canvas CF_RETURNS_RETAINED {
+    atomic_fetch_add_explicit(&canvas->_imageCount, 1, memory_order_relaxed);
+    size_t length = canvas->_height * canvas->_bytesPerRow;
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)canvas, canvas->_bytes, length, YSCJPEGProgressiveCanvasReleaseImageData);
+    if (!provider) {
+        // the callback won't be called
+        atomic_fetch_sub_explicit(&canvas->_imageCount, 1, memory_order_relaxed);
+        CFRelease((__bridge CFTypeRef)canvas);
+        return NULL;
+    }
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast;
+    CGImageRef imageRef = CGImageCreate(canvas->_width, canvas->_height, 8, 32, canvas->_bytesPerRow, YSCCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, NO, kCGRenderingIntentDefault);
+    // the image retains the provider, or the provider is released now and calls the callback
+    CGDataProviderRelease(provider);
+    return imageRef;
+}
+
+#if YSC_UIKIT || YSC_WATCH
+- (UIImageOrientation)imageOrientationFromImageData:(nonnull NSData *)data {
+    UIImageOrientation orientation = UIImageOrientationUp;
+    CGImageSourceRef imageSource = CGImageSourceCreateWithData((__bridge CFDataRef)data, NULL);
+    if (imageSource) {
+        CFDictionaryRef properties = CGImageSourceCopyPropertiesAtIndex(imageSource, 0, NULL);
+        if (properties) {
+            CFTypeRef val = CFDictionaryGetValue(properties, kCGImagePropertyOrientation);
+            if (val) {
+                NSInteger exifOrientation = 1;
+                CFNumberGetValue(val, kCFNumberNSIntegerType, &exifOrientation);
+                orientation = [YSCWebImageCoderHelper imageOrientationFromEXIFOrientation:exifOrientation];
+            }
+            CFRelease(properties);
+        }
+        CFRelease(imageSource);
+    }
+    return orientation;
+}
+#endif
+
+- (UIImage *)decompressedImageWithImage:(UIImage *)image
+                                   data:(NSData *__autoreleasing  _Nullable *)data
+                                options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
+    return [[YSCWebImageImageIOCoder sharedCoder] decompressedImageWithImage:image data:data options:optionsDict];
+}
+
+#pragma mark - Encode
+- (BOOL)canEncodeToFormat:(YSCImageFormat)format {
+    // ImageIO encodes JPEG
+    return NO;
+}
+
+- (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format {
+    return nil;
+}
+
+@end
+
+#endif
@@ -18,6 +18,24 @@
 
 + (nonnull instancetype)sharedCoder;
 
+/**
+ * The number of progressive updates that produced a partial image, counted across all the coders of the process
+ * since launch or the last reset. Progressive decoding runs on per-download coders, never on `sharedCoder`.
+ */
+@property (class, assign, readonly) NSUInteger progressiveUpdateCount;
+
+/**
+ * The number of canvases the progressive updates allocated, counted like `progressiveUpdateCount`. The updates of a
+ * download alternate between two canvases, a third one is only allocated when the partial images of both are still
+ * alive, so usually two per download.
+ */
+@property (class, assign, readonly) NSUInteger progressiveCanvasAllocationCount;
+
+/**
+ * Reset the progressive counters to zero.
+ */
++ (void)resetProgressiveCounters;
+
 @end
 
 #endif
@@ -23,9 +23,48 @@
 #import "webp/demux.h"
 #import "webp/mux.h"
 #endif
+#import <stdatomic.h>
+
+/**
+ * The pixels of a progressive canvas, shared with the partial images published from it. The canvas isn't written to
+ * while one of them is still alive.
+ */
+@interface YSCWebPProgressiveCanvas : NSObject {
+    @public
+    uint8_t *_bytes;
+    size_t _bytesPerRow;
+    int _width;
+    int _height;
+    // The number of the rows decoded, from the top
+    int _lastY;
+    _Atomic(NSUInteger) _imageCount;
+}
+
+@end
+
+@implementation YSCWebPProgressiveCanvas
+
+- (void)dealloc {
+    free(_bytes);
+}
+
+@end
+
+// Called when a partial image is released, balances the retain in `partialImageFromCanvas:`
+static void YSCWebPProgressiveCanvasReleaseImageData(void *info, const void *data, size_t size) {
+    YSCWebPProgressiveCanvas *canvas = (__bridge_transfer YSCWebPProgressiveCanvas *)info;
+    atomic_fetch_sub_explicit(&canvas->_imageCount, 1, memory_order_release);
+}
+
+// Process wide, the progressive updates of all the downloads run on their own coders and queues
+static _Atomic(NSUInteger) YSCWebPProgressiveUpdateCount;
+static _Atomic(NSUInteger) YSCWebPProgressiveCanvasAllocationCount;
 
 @implementation YSCWebImageWebPCoder {
     WebPIDecoder *_idec;
+    // The canvas of the last partial image, and the one before, which the updates alternate between
+    YSCWebPProgressiveCanvas *_progressiveCanvas;
+    YSCWebPProgressiveCanvas *_spareProgressiveCanvas;
 }
 
 - (void)dealloc {
@@ -44,6 +83,21 @@
     return coder;
 }
 
+#pragma mark - Progressive counters
+
++ (NSUInteger)progressiveUpdateCount {
+    return atomic_load_explicit(&YSCWebPProgressiveUpdateCount, memory_order_relaxed);
+}
+
++ (NSUInteger)progressiveCanvasAllocationCount {
+    return atomic_load_explicit(&YSCWebPProgressiveCanvasAllocationCount, memory_order_relaxed);
+}
+
++ (void)resetProgressiveCounters {
+    atomic_store_explicit(&YSCWebPProgressiveUpdateCount, 0, memory_order_relaxed);
+    atomic_store_explicit(&YSCWebPProgressiveCanvasAllocationCount, 0, memory_order_relaxed);
+}
+
 #pragma mark - Decode
 - (BOOL)canDecodeFromData:(nullable NSData *)data {
     return ([NSData YSC_imageFormatForImageData:data] == YSCImageFormatWebP);
@@ -166,45 +220,32 @@
     int last_y = 0;
     int stride = 0;
     uint8_t *rgba = WebPIDecGetRGB(_idec, &last_y, &width, &height, &stride);
+    // Without new rows, the previous partial image is still current
+    YSCWebPProgressiveCanvas *currentCanvas = _progressiveCanvas;
+    BOOL hasNewRows = !currentCanvas || currentCanvas->_width != width || currentCanvas->_height != height || last_y > currentCanvas->_lastY;
     // last_y may be 0, means no enough bitmap data to decode, ignore this
-    if (width + height > 0 && last_y > 0 && height >= last_y) {
-        // Construct a UIImage from the decoded RGBA value array
-        size_t rgbaSize = last_y * stride;
-        CGDataProviderRef provider =
-        CGDataProviderCreateWithData(NULL, rgba, rgbaSize, NULL);
-        CGColorSpaceRef colorSpaceRef = YSCCGColorSpaceGetDeviceRGB();
-        
-        CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast;
-        size_t components = 4;
-        CGColorRenderingIntent renderingIntent = kCGRenderingIntentDefault;
-        // Why to use last_y for image height is because of libwebp's bug (https://bugs.chromium.org/p/webp/issues/detail?id=362)
+    if (width + height > 0 && last_y > 0 && height >= last_y && hasNewRows) {
+        YSCWebPProgressiveCanvas *canvas = [self progressiveCanvasWithWidth:width height:height];
+        if (!canvas) {
+            return nil;
+        }
+        // Only the rows the canvas doesn't have yet are copied, the rows above are already in it.
+        // Why to only read up to last_y is because of libwebp's bug (https://bugs.chromium.org/p/webp/issues/detail?id=362)
         // It will not keep memory barrier safe on x86 architechure (macOS & iPhone simulator) but on ARM architecture (iPhone & iPad & tv & watch) it works great
         // If different threads use WebPIDecGetRGB to grab rgba bitmap, it will contain the previous decoded bitmap data
         // So this will cause our drawed image looks strange(above is the current part but below is the previous part)
-        // We only grab the last_y height and draw the last_y heigh instead of total height image
-        // Besides fix, this can enhance performance since we do not need to create extra bitmap
-        CGImageRef imageRef = CGImageCreate(width, last_y, 8, components * 8, components * width, colorSpaceRef, bitmapInfo, provider, NULL, NO, renderingIntent);
-        
-        CGDataProviderRelease(provider);
-        
-        if (!imageRef) {
-            return nil;
+        size_t rowLength = (size_t)width * 4;
+        for (int y = canvas->_lastY; y < last_y; y++) {
+            memcpy(canvas->_bytes + y * canvas->_bytesPerRow, rgba + (size_t)y * stride, rowLength);
         }
+        canvas->_lastY = last_y;
         
-        CGContextRef canvas = CGBitmapContextCreate(NULL, width, height, 8, 0, YSCCGColorSpaceGetDeviceRGB(), bitmapInfo);
-        if (!canvas) {
-            CGImageRelease(imageRef);
-            return nil;
-        }
-        
-        // Only draw the last_y image height, keep remains transparent, in Core Graphics coordinate system
-        CGContextDrawImage(canvas, CGRectMake(0, height - last_y, width, last_y), imageRef);
-        CGImageRef newImageRef = CGBitmapContextCreateImage(canvas);
-        CGImageRelease(imageRef);
+        // The rows below last_y stay transparent
+        CGImageRef newImageRef = [self partialImageFromCanvas:canvas];
         if (!newImageRef) {
-            CGContextRelease(canvas);
             return nil;
         }
+        atomic_fetch_add_explicit(&YSCWebPProgressiveUpdateCount, 1, memory_order_relaxed);
         
 #if YSC_UIKIT || YSC_WATCH
         image = [[UIImage alloc] initWithCGImage:newImageRef];
@@ -212,7 +253,6 @@
         image = [[UIImage alloc] initWithCGImage:newImageRef size:NSZeroSize];
 #endif
         CGImageRelease(newImageRef);
-        CGContextRelease(canvas);
     }
     
     if (finished) {
@@ -220,11 +260,69 @@
             WebPIDelete(_idec);
             _idec = NULL;
         }
+        // the partial images still alive keep them
+        _progressiveCanvas = nil;
+        _spareProgressiveCanvas = nil;
     }
     
     return image;
 }
 
+// Whether the next rows can be written to the canvas, none of its partial images is alive anymore
+static BOOL YSCWebPProgressiveCanvasIsWritable(YSCWebPProgressiveCanvas * _Nullable canvas, int width, int height) {
+    return canvas && canvas->_width == width && canvas->_height == height
+        && atomic_load_explicit(&canvas->_imageCount, memory_order_acquire) == 0;
+}
+
+// Returns the canvas to write the next rows to. The last partial image is usually still displayed when the next one is
+// decoded, but the one before has been replaced by then, so the updates alternate between two canvases. A canvas is
+// only allocated when both still have a partial image alive.
+- (nullable YSCWebPProgressiveCanvas *)progressiveCanvasWithWidth:(int)width height:(int)height {
+    if (YSCWebPProgressiveCanvasIsWritable(_progressiveCanvas, width, height)) {
+        return _progressiveCanvas;
+    }
+    if (YSCWebPProgressiveCanvasIsWritable(_spareProgressiveCanvas, width, height)) {
+        // It catches up from the decoder output, missing the rows decoded since it was last written to
+        YSCWebPProgressiveCanvas *canvas = _spareProgressiveCanvas;
+        _spareProgressiveCanvas = _progressiveCanvas;
+        _progressiveCanvas = canvas;
+        return canvas;
+    }
+    
+    YSCWebPProgressiveCanvas *newCanvas = [YSCWebPProgressiveCanvas new];
+    newCanvas->_width = width;
+    newCanvas->_height = height;
+    newCanvas->_bytesPerRow = (size_t)width * 4;
+    // zeroed, the rows not decoded yet are transparent
+    newCanvas->_bytes = calloc(height, newCanvas->_bytesPerRow);
+    if (!newCanvas->_bytes) {
+        return nil;
+    }
+    atomic_fetch_add_explicit(&YSCWebPProgressiveCanvasAllocationCount, 1, memory_order_relaxed);
+    // a busy spare is kept alive by its partial images
+    _spareProgressiveCanvas = _progressiveCanvas;
+    _progressiveCanvas = newCanvas;
+    return newCanvas;
+}
+
+// The image reads the canvas memory without copying it, the canvas isn't written to again until the image is released
+- (nullable CGImageRef)partialImageFromCanvas:(nonnull YSCWebPProgressiveCanvas *)canvas CF_RETURNS_RETAINED {
+    atomic_fetch_add_explicit(&canvas->_imageCount, 1, memory_order_relaxed);
+    size_t length = canvas->_height * canvas->_bytesPerRow;
+    CGDataProviderRef provider = CGDataProviderCreateWithData((__bridge_retained void *)canvas, canvas->_bytes, length, YSCWebPProgressiveCanvasReleaseImageData);
+    if (!provider) {
+        // the callback won't be called
+        atomic_fetch_sub_explicit(&canvas->_imageCount, 1, memory_order_relaxed);
+        CFRelease((__bridge CFTypeRef)canvas);
+        return NULL;
+    }
+    CGBitmapInfo bitmapInfo = kCGBitmapByteOrder32Big | kCGImageAlphaPremultipliedLast;
+    CGImageRef imageRef = CGImageCreate(canvas->_width, canvas->_height, 8, 32, canvas->_bytesPerRow, YSCCGColorSpaceGetDeviceRGB(), bitmapInfo, provider, NULL, NO, kCGRenderingIntentDefault);
+    // the image retains the provider, or the provider is released now and calls the callback
+    CGDataProviderRelease(provider);
+    return imageRef;
+}
+
 - (UIImage *)decompressedImageWithImage:(UIImage *)image
                                    data:(NSData *__autoreleasing  _Nullable *)data
                                 options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
@@ -320,16 +418,26 @@
 }
 
 - (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format {
+    return [self encodedDataWithImage:image format:format options:nil];
+}
+
+- (NSData *)encodedDataWithImage:(UIImage *)image format:(YSCImageFormat)format options:(nullable NSDictionary<NSString*, NSObject*>*)optionsDict {
     if (!image) {
         return nil;
     }
     
+    float quality = 100.0;
+    NSNumber *compressionQuality = (NSNumber *)optionsDict[YSCWebImageCoderEncodeCompressionQualityKey];
+    if ([compressionQuality isKindOfClass:[NSNumber class]]) {
+        quality = MIN(MAX(compressionQuality.floatValue, 0), 1) * 100.0;
+    }
+    
     NSData *data;
     
     NSArray<YSCWebImageFrame *> *frames = [YSCWebImageCoderHelper framesFromAnimatedImage:image];
     if (frames.count == 0) {
         // for static single webp image
-        data = [self YSC_encodedWebpDataWithImage:image];
+        data = [self YSC_encodedWebpDataWithImage:image quality:quality];
     } else {
         // for animated webp image
         WebPMux *mux = WebPMuxNew();
@@ -338,7 +446,7 @@
         }
         for (size_t i = 0; i < frames.count; i++) {
             YSCWebImageFrame *currentFrame = frames[i];
-            NSData *webpData = [self YSC_encodedWebpDataWithImage:currentFrame.image];
+            NSData *webpData = [self YSC_encodedWebpDataWithImage:currentFrame.image quality:quality];
             int duration = currentFrame.duration * 1000;
             WebPMuxFrameInfo frame = { .bitstream.bytes = webpData.bytes,
                 .bitstream.size = webpData.length,
@@ -375,7 +483,7 @@
     return data;
 }
 
-- (nullable NSData *)YSC_encodedWebpDataWithImage:(nullable UIImage *)image {
+- (nullable NSData *)YSC_encodedWebpDataWithImage:(nullable UIImage *)image quality:(float)quality {
     if (!image) {
         return nil;
     }
@@ -398,7 +506,6 @@
     uint8_t *rgba = (uint8_t *)CFDataGetBytePtr(dataRef);
     
     uint8_t *data = NULL;
-    float quality = 100.0;
     size_t size = WebPEncodeRGBA(rgba, (int)width, (int)height, (int)bytesPerRow, quality, &data);
     CFRelease(dataRef);
     rgba = NULL;
@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import "YSCWebImageCompat.h"
 #import "YSCWebImageOperation.h"
+#import "YSCWebImageProgressiveDecodeScheduler.h"
 
 typedef NS_OPTIONS(NSUInteger, YSCWebImageDownloaderOptions) {
     YSCWebImageDownloaderLowPriority = 1 << 0,
@@ -101,6 +102,11 @@ typedef YSCHTTPHeadersDictionary * _Nullable (^YSCWebImageDownloaderHeadersFilte
  */
 @property (assign, nonatomic) BOOL shouldDecompressImages;
 
+/**
+ * When the progressive downloads decode a partial image. The policy is copied by the operations when they are created.
+ */
+@property (copy, nonatomic, nonnull) YSCWebImageProgressiveDecodePolicy *progressiveDecodePolicy;
+
 /**
  *  The maximum number of concurrent downloads
  */
@@ -25,6 +25,8 @@
 
 // The session in which data tasks will run
 @property (strong, nonatomic) NSURLSession *session;
+// The operations by the identifier of their task, filled on the first delegate callback of each task
+@property (strong, nonatomic, nonnull) NSMapTable<NSNumber *, YSCWebImageDownloaderOperation *> *taskOperations;
 
 @end
 
@@ -70,11 +72,13 @@
     if ((self = [super init])) {
         _operationClass = [YSCWebImageDownloaderOperation class];
         _shouldDecompressImages = YES;
+        _progressiveDecodePolicy = [YSCWebImageProgressiveDecodePolicy new];
         _executionOrder = YSCWebImageDownloaderFIFOExecutionOrder;
         _downloadQueue = [NSOperationQueue new];
         _downloadQueue.maxConcurrentOperationCount = 6;
         _downloadQueue.name = @"com.hackemist.YSCWebImageDownloader";
         _URLOperations = [NSMutableDictionary new];
+        _taskOperations = [NSMapTable strongToWeakObjectsMapTable];
 #ifdef YSC_WEBP
         _HTTPHeaders = [@{@"Accept": @"image/webp,image/*;q=0.8"} mutableCopy];
 #else
@@ -94,6 +98,10 @@
     if (self.session) {
         [self.session invalidateAndCancel];
     }
+    // The task identifiers are only unique in a session
+    @synchronized (self.taskOperations) {
+        [self.taskOperations removeAllObjects];
+    }
 
     sessionConfiguration.timeoutIntervalForRequest = self.downloadTimeout;
 
@@ -187,6 +195,10 @@
         }
         YSCWebImageDownloaderOperation *operation = [[sself.operationClass alloc] initWithRequest:request inSession:sself.session options:options];
         operation.shouldDecompressImages = sself.shouldDecompressImages;
+        // not part of YSCWebImageDownloaderOperationInterface, the custom operations may not have it
+        if ([operation respondsToSelector:@selector(setProgressiveDecodePolicy:)]) {
+            operation.progressiveDecodePolicy = sself.progressiveDecodePolicy;
+        }
         
         if (sself.urlCredential) {
             operation.credential = sself.urlCredential;
@@ -273,6 +285,14 @@
 #pragma mark Helper methods
 
 - (YSCWebImageDownloaderOperation *)operationWithTask:(NSURLSessionTask *)task {
+    NSNumber *taskIdentifier = @(task.taskIdentifier);
+    @synchronized (self.taskOperations) {
+        YSCWebImageDownloaderOperation *operation = [self.taskOperations objectForKey:taskIdentifier];
+        if (operation.dataTask == task) {
+            return operation;
+        }
+    }
+    // The tasks are created when the operations start, so the queue is only scanned once per task, not for every chunk
     YSCWebImageDownloaderOperation *returnOperation = nil;
     for (YSCWebImageDownloaderOperation *operation in self.downloadQueue.operations) {
         if (operation.dataTask.taskIdentifier == task.taskIdentifier) {
@@ -280,9 +300,20 @@
             break;
         }
     }
+    if (returnOperation) {
+        @synchronized (self.taskOperations) {
+            [self.taskOperations setObject:returnOperation forKey:taskIdentifier];
+        }
+    }
     return returnOperation;
 }
 
+- (void)removeOperationWithTask:(NSURLSessionTask *)task {
+    @synchronized (self.taskOperations) {
+        [self.taskOperations removeObjectForKey:@(task.taskIdentifier)];
+    }
+}
+
 #pragma mark NSURLSessionDataDelegate
 
 - (void)URLSession:(NSURLSession *)session
@@ -321,6 +352,8 @@ didReceiveResponse:(NSURLResponse *)response
     
     // Identify the operation that runs this task and pass it the delegate method
     YSCWebImageDownloaderOperation *dataOperation = [self operationWithTask:task];
+    // The last callback of the task
+    [self removeOperationWithTask:task];
 
     [dataOperation URLSession:session task:task didCompleteWithError:error];
 }
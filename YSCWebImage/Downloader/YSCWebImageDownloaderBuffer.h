@@ -0,0 +1,53 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * The receive buffer of a download. The bytes are appended to a contiguous storage allocated once when the size of the
+ * response is known, or grown geometrically otherwise, and the bytes already received are never moved or modified.
+ * The data handed out are read only views of the storage, which stays alive as long as one of them does, so
+ * decoders can keep them while the download goes on.
+ *
+ * Not thread safe, the appends are expected from the serial delegate queue of the session.
+ */
+@interface YSCWebImageDownloaderBuffer : NSObject
+
+/**
+ * The number of bytes received
+ */
+@property (nonatomic, assign, readonly) NSUInteger length;
+
+/**
+ * Whether an append failed, the storage couldn't grow. The buffer then ignores the later appends, its data misses bytes.
+ */
+@property (nonatomic, assign, readonly, getter=isFailed) BOOL failed;
+
+/**
+ * @param expectedLength The expected size of the response, 0 when unknown
+ */
+- (nonnull instancetype)initWithExpectedLength:(NSUInteger)expectedLength NS_DESIGNATED_INITIALIZER;
+
+/**
+ * @return NO if the storage couldn't grow to hold the data, the buffer is failed then
+ */
+- (BOOL)appendData:(nonnull NSData *)data;
+
+/**
+ * Returns the bytes received so far without copying them. The returned data doesn't change with the later appends.
+ */
+- (nonnull NSData *)data;
+
+/**
+ * Returns all the bytes received, to be handed to the decoders and the cache. It's the storage itself when the response
+ * had its expected size, a view of it otherwise, copied only when the storage is much bigger than the bytes.
+ */
+- (nonnull NSData *)finishedData;
+
+@end
@@ -0,0 +1,106 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCWebImageDownloaderBuffer.h"
+
+// The capacity of a buffer of unknown size, doubled as needed
+static const NSUInteger kYSCBufferInitialCapacity = 16 * 1024;
+// A bogus Content-Length doesn't allocate more than this upfront
+static const NSUInteger kYSCBufferMaxPreallocatedCapacity = 32 * 1024 * 1024;
+
+@interface YSCWebImageDownloaderBuffer ()
+
+@property (nonatomic, assign, readwrite) NSUInteger length;
+@property (nonatomic, assign, readwrite, getter=isFailed) BOOL failed;
+
+@end
+
+@implementation YSCWebImageDownloaderBuffer {
+    // Owns `_bytes`, retained by every view handed out. Immutable, so copying it or a view is free.
+    NSData *_storage;
+    uint8_t *_bytes;
+    NSUInteger _capacity;
+}
+
+- (nonnull instancetype)init {
+    return [self initWithExpectedLength:0];
+}
+
+- (nonnull instancetype)initWithExpectedLength:(NSUInteger)expectedLength {
+    if ((self = [super init])) {
+        if (expectedLength > 0) {
+            [self allocateStorageWithCapacity:MIN(expectedLength, kYSCBufferMaxPreallocatedCapacity)];
+        }
+    }
+    return self;
+}
+
+- (void)allocateStorageWithCapacity:(NSUInteger)capacity {
+    uint8_t *bytes = malloc(capacity);
+    if (!bytes) {
+        return;
+    }
+    // the bytes received so far, the only copy of the buffer when it grows
+    if (_length > 0) {
+        memcpy(bytes, _bytes, _length);
+    }
+    // the previous storage lives on in the views of it
+    _storage = [[NSData alloc] initWithBytesNoCopy:bytes length:capacity freeWhenDone:YES];
+    _bytes = bytes;
+    _capacity = capacity;
+}
+
+- (BOOL)appendData:(nonnull NSData *)data {
+    if (_failed) {
+        return NO;
+    }
+    NSUInteger dataLength = data.length;
+    if (dataLength == 0) {
+        return YES;
+    }
+    if (_length + dataLength > _capacity) {
+        [self allocateStorageWithCapacity:MAX(_length + dataLength, MAX(_capacity * 2, kYSCBufferInitialCapacity))];
+        if (_length + dataLength > _capacity) {
+            // out of memory, the bytes after a missing chunk would be garbage to the decoders
+            self.failed = YES;
+            return NO;
+        }
+    }
+    // The chunks may be discontiguous dispatch data, copied in place one region at a time
+    uint8_t *destination = _bytes + _length;
+    [data enumerateByteRangesUsingBlock:^(const void *bytes, NSRange byteRange, BOOL *stop) {
+        memcpy(destination + byteRange.location, bytes, byteRange.length);
+    }];
+    // The bytes past `length` are written before a view can see them
+    self.length = _length + dataLength;
+    return YES;
+}
+
+- (nonnull NSData *)data {
+    if (_length == 0) {
+        return [NSData data];
+    }
+    if (_length == _capacity) {
+        return _storage;
+    }
+    NSData *storage = _storage;
+    return [[NSData alloc] initWithBytesNoCopy:_bytes length:_length deallocator:^(void *bytes, NSUInteger length) {
+        // keeps the storage alive until the view goes away
+        (void)storage;
+    }];
+}
+
+- (nonnull NSData *)finishedData {
+    // Don't keep a storage much bigger than the data alive, in the memory cache for example
+    if (_length > 0 && _capacity - _length > _length / 4) {
+        return [NSData dataWithBytes:_bytes length:_length];
+    }
+    return [self data];
+}
+
+@end
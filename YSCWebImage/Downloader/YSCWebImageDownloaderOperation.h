@@ -9,6 +9,7 @@
 #import <Foundation/Foundation.h>
 #import "YSCWebImageDownloader.h"
 #import "YSCWebImageOperation.h"
+#import "YSCWebImageProgressiveDecodeScheduler.h"
 
 FOUNDATION_EXPORT NSString * _Nonnull const YSCWebImageDownloadStartNotification;
 FOUNDATION_EXPORT NSString * _Nonnull const YSCWebImageDownloadReceiveResponseNotification;
@@ -53,6 +54,11 @@ FOUNDATION_EXPORT NSString * _Nonnull const YSCWebImageDownloadFinishNotificatio
 
 @property (assign, nonatomic) BOOL shouldDecompressImages;
 
+/**
+ * When to decode the partial images of a `YSCWebImageDownloaderProgressiveDownload`. Set before the operation starts.
+ */
+@property (copy, nonatomic, nonnull) YSCWebImageProgressiveDecodePolicy *progressiveDecodePolicy;
+
 /**
  *  Was used to determine whether the URL connection should consult the credential storage for authenticating the connection.
  *  @deprecated Not used for a couple of versions
@@ -10,6 +10,7 @@
 #import "YSCWebImageManager.h"
 #import "NSImage+YSCWebCache.h"
 #import "YSCWebImageCodersManager.h"
+#import "YSCWebImageDownloaderBuffer.h"
 
 NSString *const YSCWebImageDownloadStartNotification = @"YSCWebImageDownloadStartNotification";
 NSString *const YSCWebImageDownloadReceiveResponseNotification = @"YSCWebImageDownloadReceiveResponseNotification";
@@ -27,7 +28,8 @@ typedef NSMutableDictionary<NSString *, id> YSCCallbacksDictionary;
 
 @property (assign, nonatomic, getter = isExecuting) BOOL executing;
 @property (assign, nonatomic, getter = isFinished) BOOL finished;
-@property (strong, nonatomic, nullable) NSMutableData *imageData;
+// Only used from the delegate queue of the session
+@property (strong, nonatomic, nullable) YSCWebImageDownloaderBuffer *imageBuffer;
 @property (copy, nonatomic, nullable) NSData *cachedData;
 
 // This is weak because it is injected by whoever manages this session. If this gets nil-ed out, we won't be able to run
@@ -45,6 +47,7 @@ typedef NSMutableDictionary<NSString *, id> YSCCallbacksDictionary;
 #endif
 
 @property (strong, nonatomic, nullable) id<YSCWebImageProgressiveCoder> progressiveCoder;
+@property (strong, nonatomic, nullable) YSCWebImageProgressiveDecodeScheduler *progressiveDecodeScheduler;
 
 @end
 
@@ -68,6 +71,7 @@ typedef NSMutableDictionary<NSString *, id> YSCCallbacksDictionary;
         _executing = NO;
         _finished = NO;
         _expectedSize = 0;
+        _progressiveDecodePolicy = [YSCWebImageProgressiveDecodePolicy new];
         _unownedSession = session;
         _barrierQueue = dispatch_queue_create("com.hackemist.YSCWebImageDownloaderOperationBarrierQueue", DISPATCH_QUEUE_CONCURRENT);
     }
@@ -228,6 +232,7 @@ typedef NSMutableDictionary<NSString *, id> YSCCallbacksDictionary;
         [weakSelf.callbackBlocks removeAllObjects];
     });
     self.dataTask = nil;
+    [self.progressiveDecodeScheduler stop];
     
     NSOperationQueue *delegateQueue;
     if (self.unownedSession) {
@@ -238,7 +243,7 @@ typedef NSMutableDictionary<NSString *, id> YSCCallbacksDictionary;
     if (delegateQueue) {
         NSAssert(delegateQueue.maxConcurrentOperationCount == 1, @"NSURLSession delegate queue should be a serial queue");
         [delegateQueue addOperationWithBlock:^{
-            weakSelf.imageData = nil;
+            weakSelf.imageBuffer = nil;
         }];
     }
     
@@ -280,7 +285,7 @@ didReceiveResponse:(NSURLResponse *)response
             progressBlock(0, expected, self.request.URL);
         }
         
-        self.imageData = [[NSMutableData alloc] initWithCapacity:expected];
+        self.imageBuffer = [[YSCWebImageDownloaderBuffer alloc] initWithExpectedLength:expected];
         self.response = response;
         __weak typeof(self) weakSelf = self;
         dispatch_async(dispatch_get_main_queue(), ^{
@@ -312,17 +317,19 @@ didReceiveResponse:(NSURLResponse *)response
 }
 
 - (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data {
-    [self.imageData appendData:data];
+    if (![self.imageBuffer appendData:data]) {
+        // The data misses a chunk, stop the download, the completion reports the failure
+        [dataTask cancel];
+        return;
+    }
 
     if ((self.options & YSCWebImageDownloaderProgressiveDownload) && self.expectedSize > 0) {
-        // Get the image data
-        NSData *imageData = [self.imageData copy];
-        // Get the total bytes downloaded
-        const NSInteger totalSize = imageData.length;
-        // Get the finish status
-        BOOL finished = (totalSize >= self.expectedSize);
+        // Get the image data, a view of the buffer rather than a copy
+        NSData *imageData = [self.imageBuffer data];
+        // The complete image is decoded when the task completes
+        BOOL finished = (imageData.length >= self.expectedSize);
         
-        if (!self.progressiveCoder) {
+        if (!finished && !self.progressiveCoder) {
             // We need to create a new instance for progressive decoding to avoid conflicts
             for (id<YSCWebImageCoder>coder in [YSCWebImageCodersManager sharedInstance].coders) {
                 if ([coder conformsToProtocol:@protocol(YSCWebImageProgressiveCoder)] &&
@@ -333,20 +340,13 @@ didReceiveResponse:(NSURLResponse *)response
             }
         }
         
-        UIImage *image = [self.progressiveCoder incrementallyDecodedImageWithData:imageData finished:finished];
-        if (image) {
-            NSString *key = [[YSCWebImageManager sharedManager] cacheKeyForURL:self.request.URL];
-            image = [self scaledImageForKey:key image:image];
-            if (self.shouldDecompressImages) {
-                image = [[YSCWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&data options:@{YSCWebImageCoderScaleDownLargeImagesKey: @(NO)}];
-            }
-            
-            [self callCompletionBlocksWithImage:image imageData:nil error:nil finished:NO];
+        if (!finished && self.progressiveCoder) {
+            [[self progressiveDecodeSchedulerWithCoder:self.progressiveCoder] updateWithData:imageData];
         }
     }
 
     for (YSCWebImageDownloaderProgressBlock progressBlock in [self callbacksForKey:kProgressCallbackKey]) {
-        progressBlock(self.imageData.length, self.expectedSize, self.request.URL);
+        progressBlock(self.imageBuffer.length, self.expectedSize, self.request.URL);
     }
 }
 
@@ -369,6 +369,8 @@ didReceiveResponse:(NSURLResponse *)response
 #pragma mark NSURLSessionTaskDelegate
 
 - (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error {
+    // No partial image after the final one
+    [self.progressiveDecodeScheduler stop];
     @synchronized(self) {
         self.dataTask = nil;
         __weak typeof(self) weakSelf = self;
@@ -380,14 +382,16 @@ didReceiveResponse:(NSURLResponse *)response
         });
     }
     
-    if (error) {
+    if (self.imageBuffer.isFailed) {
+        [self callCompletionBlocksWithError:[NSError errorWithDomain:YSCWebImageErrorDomain code:0 userInfo:@{NSLocalizedDescriptionKey : @"Not enough memory to receive the image data"}]];
+    } else if (error) {
         [self callCompletionBlocksWithError:error];
     } else {
         if ([self callbacksForKey:kCompletedCallbackKey].count > 0) {
             /**
              *  If you specified to use `NSURLCache`, then the response you get here is what you need.
              */
-            NSData *imageData = [self.imageData copy];
+            NSData *imageData = [self.imageBuffer finishedData];
             if (imageData) {
                 /**  if you specified to only use cached data via `YSCWebImageDownloaderIgnoreCachedResponse`,
                  *  then we should check if the cached data is equal to image data
@@ -464,6 +468,28 @@ didReceiveResponse:(NSURLResponse *)response
 }
 
 #pragma mark Helper methods
+
+// The coder is only used from the decode queue of the scheduler from now on
+- (nonnull YSCWebImageProgressiveDecodeScheduler *)progressiveDecodeSchedulerWithCoder:(nonnull id<YSCWebImageProgressiveCoder>)coder {
+    if (!self.progressiveDecodeScheduler) {
+        __weak typeof(self) weakSelf = self;
+        self.progressiveDecodeScheduler = [[YSCWebImageProgressiveDecodeScheduler alloc] initWithPolicy:self.progressiveDecodePolicy decodeBlock:^UIImage *(NSData *data) {
+            __strong typeof(weakSelf) strongSelf = weakSelf;
+            UIImage *image = [coder incrementallyDecodedImageWithData:data finished:NO];
+            if (image && strongSelf) {
+                NSString *key = [[YSCWebImageManager sharedManager] cacheKeyForURL:strongSelf.request.URL];
+                image = [strongSelf scaledImageForKey:key image:image];
+                if (strongSelf.shouldDecompressImages) {
+                    image = [[YSCWebImageCodersManager sharedInstance] decompressedImageWithImage:image data:&data options:@{YSCWebImageCoderScaleDownLargeImagesKey: @(NO)}];
+                }
+            }
+            return image;
+        } deliverBlock:^(UIImage *image) {
+            [weakSelf callCompletionBlocksWithImage:image imageData:nil error:nil finished:NO];
+        }];
+    }
+    return self.progressiveDecodeScheduler;
+}
 - (nullable UIImage *)scaledImageForKey:(nullable NSString *)key image:(nullable UIImage *)image {
     return YSCScaledImageForKey(key, image);
 }
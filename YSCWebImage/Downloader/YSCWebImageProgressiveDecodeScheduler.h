@@ -0,0 +1,65 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import <Foundation/Foundation.h>
+#import "YSCWebImageCompat.h"
+
+/**
+ * When the progressive downloads decode a partial image. A decode waits for all the enabled conditions.
+ */
+@interface YSCWebImageProgressiveDecodePolicy : NSObject <NSCopying>
+
+/**
+ * The number of bytes to receive since the last decode. Defaults to 8 KB.
+ */
+@property (assign, nonatomic) NSUInteger minimumByteDelta;
+
+/**
+ * The time since the last decode, in seconds. Defaults to 0.1.
+ */
+@property (assign, nonatomic) NSTimeInterval minimumInterval;
+
+/**
+ * Whether the progressive JPEGs are only decoded when a new scan is complete, the partial scans adding little detail.
+ * The baseline JPEGs and the other formats only use the other conditions. Defaults to YES.
+ */
+@property (assign, nonatomic) BOOL shouldWaitForJPEGScans;
+
+@end
+
+typedef UIImage * _Nullable (^YSCWebImageProgressiveDecodeBlock)(NSData * _Nonnull data);
+typedef void (^YSCWebImageProgressiveDeliverBlock)(UIImage * _Nonnull image);
+
+/**
+ * Throttles the partial decodes of a progressive download. The decodes run one at a time on a low priority queue, and
+ * a decode still waiting when more data arrives is dropped in favor of the newer data.
+ */
+@interface YSCWebImageProgressiveDecodeScheduler : NSObject
+
+- (nonnull instancetype)init NS_UNAVAILABLE;
+
+/**
+ * @param decodeBlock  Decodes the partial data, on the decode queue
+ * @param deliverBlock Delivers a decoded image, on the decode queue, unless the scheduler was stopped meanwhile
+ */
+- (nonnull instancetype)initWithPolicy:(nonnull YSCWebImageProgressiveDecodePolicy *)policy
+                           decodeBlock:(nonnull YSCWebImageProgressiveDecodeBlock)decodeBlock
+                          deliverBlock:(nonnull YSCWebImageProgressiveDeliverBlock)deliverBlock NS_DESIGNATED_INITIALIZER;
+
+/**
+ * Called with all the data received so far after each chunk, from a single serial queue.
+ * The data must not change afterwards.
+ */
+- (void)updateWithData:(nonnull NSData *)data;
+
+/**
+ * Drop the pending decodes. No image is delivered once this returns, so the final image can't be overtaken.
+ */
+- (void)stop;
+
+@end
@@ -0,0 +1,229 @@
+/*
+ * This file is part of the YSCWebImage package.
+ * (c) Olivier Poitrey <rs@dailymotion.com>
+ *
+ * For the full copyright and license information, please view the LICENSE
+ * file that was distributed with this source code.
+ */
+
+#import "YSCWebImageProgressiveDecodeScheduler.h"
+
+@implementation YSCWebImageProgressiveDecodePolicy
+
+- (instancetype)init {
+    if ((self = [super init])) {
+        _minimumByteDelta = 8 * 1024;
+        _minimumInterval = 0.1;
+        _shouldWaitForJPEGScans = YES;
+    }
+    return self;
+}
+
+- (id)copyWithZone:(NSZone *)zone {
+    YSCWebImageProgressiveDecodePolicy *policy = [[[self class] allocWithZone:zone] init];
+    policy.minimumByteDelta = self.minimumByteDelta;
+    policy.minimumInterval = self.minimumInterval;
+    policy.shouldWaitForJPEGScans = self.shouldWaitForJPEGScans;
+    return policy;
+}
+
+@end
+
+typedef NS_ENUM(NSInteger, YSCJPEGParseState) {
+    YSCJPEGParseStateUnknown,
+    YSCJPEGParseStateNotJPEG,
+    // the marker segments between the scans
+    YSCJPEGParseStateSegments,
+    // the entropy coded data of a scan
+    YSCJPEGParseStateScan,
+    YSCJPEGParseStateDone
+};
+
+@implementation YSCWebImageProgressiveDecodeScheduler {
+    YSCWebImageProgressiveDecodePolicy *_policy;
+    YSCWebImageProgressiveDecodeBlock _decodeBlock;
+    YSCWebImageProgressiveDeliverBlock _deliverBlock;
+    dispatch_queue_t _decodeQueue;
+
+    // Only used from the queue of the updates
+    NSUInteger _scheduledLength;
+    CFAbsoluteTime _scheduledTime;
+    NSUInteger _scheduledScanCount;
+    YSCJPEGParseState _jpegState;
+    NSUInteger _jpegOffset;
+    BOOL _progressiveJPEG;
+    NSUInteger _jpegScanCount;
+
+    // Guarded by self
+    NSData *_pendingData;
+    BOOL _stopped;
+}
+
+- (nonnull instancetype)initWithPolicy:(nonnull YSCWebImageProgressiveDecodePolicy *)policy
+                           decodeBlock:(nonnull YSCWebImageProgressiveDecodeBlock)decodeBlock
+                          deliverBlock:(nonnull YSCWebImageProgressiveDeliverBlock)deliverBlock {
+    if ((self = [super init])) {
+        _policy = [policy copy];
+        _decodeBlock = [decodeBlock copy];
+        _deliverBlock = [deliverBlock copy];
+        _decodeQueue = dispatch_queue_create("com.hackemist.YSCWebImageProgressiveDecode", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_decodeQueue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+    }
+    return self;
+}
+
+#pragma mark - Scheduling
+
+- (void)updateWithData:(nonnull NSData *)data {
+    NSUInteger length = data.length;
+    if (length <= _scheduledLength || length - _scheduledLength < _policy.minimumByteDelta) {
+        return;
+    }
+    CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+    if (now - _scheduledTime < _policy.minimumInterval) {
+        return;
+    }
+    if (_policy.shouldWaitForJPEGScans) {
+        [self parseJPEGData:data];
+        if (_progressiveJPEG && _jpegScanCount == _scheduledScanCount) {
+            return;
+        }
+    }
+    _scheduledLength = length;
+    _scheduledTime = now;
+    _scheduledScanCount = _jpegScanCount;
+
+    BOOL shouldDispatch;
+    @synchronized (self) {
+        if (_stopped) {
+            return;
+        }
+        // A decode already waiting takes the newer data, the older one is dropped
+        shouldDispatch = !_pendingData;
+        _pendingData = data;
+    }
+    if (shouldDispatch) {
+        dispatch_async(_decodeQueue, ^{
+            [self decodePendingData];
+        });
+    }
+}
+
+- (void)stop {
+    @synchronized (self) {
+        _stopped = YES;
+        _pendingData = nil;
+    }
+}
+
+// Must be called from the decode queue
+- (void)decodePendingData {
+    NSData *data;
+    @synchronized (self) {
+        data = _pendingData;
+        _pendingData = nil;
+    }
+    if (!data) {
+        return;
+    }
+    @autoreleasepool {
+        UIImage *image = _decodeBlock(data);
+        if (!image) {
+            return;
+        }
+        // Delivered under the lock, so `stop` returns either before the delivery is enqueued or with no delivery
+        @synchronized (self) {
+            if (!_stopped) {
+                _deliverBlock(image);
+            }
+        }
+    }
+}
+
+#pragma mark - JPEG scans
+
+// Counts the complete scans, resuming where the previous call stopped. Only the markers are read, the entropy coded
+// data is skipped by looking for the next 0xFF not followed by a stuffed zero or a restart marker.
+- (void)parseJPEGData:(nonnull NSData *)data {
+    const uint8_t *bytes = data.bytes;
+    NSUInteger length = data.length;
+    if (_jpegState == YSCJPEGParseStateUnknown) {
+        if (length < 2) {
+            return;
+        }
+        BOOL isJPEG = bytes[0] == 0xFF && bytes[1] == 0xD8;
+        _jpegState = isJPEG ? YSCJPEGParseStateSegments : YSCJPEGParseStateNotJPEG;
+        _jpegOffset = 2;
+    }
+    while (_jpegState == YSCJPEGParseStateSegments || _jpegState == YSCJPEGParseStateScan) {
+        NSUInteger offset = _jpegOffset;
+        if (_jpegState == YSCJPEGParseStateScan) {
+            while (offset + 1 < length) {
+                const uint8_t *marker = memchr(bytes + offset, 0xFF, length - offset - 1);
+                if (!marker) {
+                    offset = length - 1;
+                    break;
+                }
+                offset = marker - bytes;
+                uint8_t code = bytes[offset + 1];
+                if (code == 0x00 || (code >= 0xD0 && code <= 0xD7)) {
+                    offset += 2;
+                } else if (code == 0xFF) {
+                    offset++;
+                } else {
+                    // any other marker ends the scan
+                    _jpegScanCount++;
+                    _jpegState = YSCJPEGParseStateSegments;
+                    break;
+                }
+            }
+            _jpegOffset = offset;
+            if (_jpegState == YSCJPEGParseStateScan) {
+                return;
+            }
+            continue;
+        }
+
+        if (offset + 2 > length) {
+            return;
+        }
+        if (bytes[offset] != 0xFF) {
+            // not what we expected, the other conditions still apply
+            _jpegState = YSCJPEGParseStateNotJPEG;
+            _progressiveJPEG = NO;
+            return;
+        }
+        uint8_t code = bytes[offset + 1];
+        if (code == 0xFF) {
+            // fill byte
+            _jpegOffset = offset + 1;
+            continue;
+        }
+        if (code == 0xD9) {
+            _jpegState = YSCJPEGParseStateDone;
+            return;
+        }
+        if (code == 0x01 || (code >= 0xD0 && code <= 0xD8)) {
+            // markers without a segment
+            _jpegOffset = offset + 2;
+            continue;
+        }
+        if (offset + 4 > length) {
+            return;
+        }
+        NSUInteger segmentLength = (NSUInteger)bytes[offset + 2] << 8 | bytes[offset + 3];
+        if (offset + 2 + segmentLength > length) {
+            return;
+        }
+        // SOF2, SOF6, SOF10 and SOF14 start a progressive frame
+        if (code == 0xC2 || code == 0xC6 || code == 0xCA || code == 0xCE) {
+            _progressiveJPEG = YES;
+        }
+        _jpegOffset = offset + 2 + segmentLength;
+        if (code == 0xDA) {
+            _jpegState = YSCJPEGParseStateScan;
+        }
+    }
+}
+
+@end